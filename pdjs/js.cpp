@@ -3,27 +3,194 @@
 #include <libplatform/libplatform.h>
 #include <v8.h>
 #include <v8-version-string.h>
+#include <v8-profiler.h>
 #if WIN32
 #include <Windows.h>
 #include <process.h>
 #include <comdef.h>
+#include <direct.h>
 #endif
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <cmath>
 #include <vector>
 #include <map>
-#include <unordered_set>
+#include <unordered_map>
 
 using namespace std;
 
 static t_class* js_class;
 static t_class* js_inlet_class;
+static t_class* js_tilde_class;
+static t_class* js_settings_class;
 static unique_ptr<v8::Platform> js_platform;
 static v8::Isolate* js_isolate;
-static unordered_set<v8::Persistent<v8::Object>*> jsobjects;
+// Objects passed between js instances. Atoms carry the index into jsobjects as a
+// float; freed slots are reused so ids stay exactly representable by t_float.
+static vector<v8::Global<v8::Object>> jsobjects(1); // id 0 means no object
+static vector<uint32_t> jsobjects_free;
+static const uint32_t jsobjects_max = 1 << 24;
 static v8::Eternal<v8::Object>* js_global = nullptr;
+static v8::Eternal<v8::Object>* js_modules = nullptr;
+// Context shared modules are evaluated in, see js_get_module_context.
+static v8::Eternal<v8::Context> js_module_context;
+// Instance on whose behalf modules are currently loaded, so that compile can reload
+// them. Only compared, never dereferenced.
+static struct _js* js_module_loader = nullptr;
+
+// embedder data slot of a context holding the t_js it belongs to
+static const int js_context_owner = 1;
 
 struct _js_inlet;
 
+typedef struct _js_script
+{
+    size_t hash;
+    v8::Global<v8::UnboundScript> script;
+} t_js_script;
+
+enum js_cache_kind
+{
+    JS_CACHE_SCRIPT,
+    JS_CACHE_FUNCTION,
+    JS_CACHE_MODULE,
+    JS_CACHE_ESMODULE
+};
+
+static unordered_map<string, t_js_script> js_scripts;
+
+typedef struct _js_esmodule
+{
+    string path;
+    struct _js* owner; // only compared, never dereferenced
+    bool entry; // compiled in the owner's context rather than shared
+    v8::Global<v8::Module> module;
+} t_js_esmodule;
+
+// Every compiled ES module by identity hash, to find the file an import comes from.
+static unordered_multimap<int, t_js_esmodule> js_esmodules;
+// Imported ES modules shared by all instances, by normalized path.
+static unordered_map<string, v8::Global<v8::Module>> js_esmodule_map;
+
+// Counts the ArrayBuffer backing stores V8 allocates, so js~ can report allocations
+// made inside perform.
+class js_counting_allocator : public v8::ArrayBuffer::Allocator
+{
+public:
+    std::unique_ptr<v8::ArrayBuffer::Allocator> allocator;
+    uint64_t count = 0;
+
+    js_counting_allocator() : allocator(v8::ArrayBuffer::Allocator::NewDefaultAllocator()) {}
+
+    void* Allocate(size_t length) override
+    {
+        count++;
+        return allocator->Allocate(length);
+    }
+
+    void* AllocateUninitialized(size_t length) override
+    {
+        count++;
+        return allocator->AllocateUninitialized(length);
+    }
+
+    void Free(void* data, size_t length) override
+    {
+        allocator->Free(data, length);
+    }
+};
+
+static js_counting_allocator* js_allocator = NULL;
+static uint64_t js_gc_count = 0;
+// Bytes freed by all collections, so that used heap plus freed bytes only grows.
+// Updated from the GC callbacks, perform itself doesn't query the heap.
+static uint64_t js_gc_freed = 0;
+static size_t js_gc_used = 0;
+
+static void js_gc_prologue(v8::Isolate* isolate, v8::GCType type, v8::GCCallbackFlags flags)
+{
+    v8::HeapStatistics heap;
+
+    isolate->GetHeapStatistics(&heap);
+    js_gc_used = heap.used_heap_size();
+    js_gc_count++;
+}
+
+static void js_gc_epilogue(v8::Isolate* isolate, v8::GCType type, v8::GCCallbackFlags flags)
+{
+    v8::HeapStatistics heap;
+
+    isolate->GetHeapStatistics(&heap);
+    if (heap.used_heap_size() < js_gc_used)
+        js_gc_freed += js_gc_used - heap.used_heap_size();
+}
+
+// Bytes allocated on the JS heap since the isolate was created. Only called around
+// the sampled perform calls, so the heap isn't queried every block.
+static uint64_t js_heap_allocated()
+{
+    v8::HeapStatistics heap;
+
+    js_isolate->GetHeapStatistics(&heap);
+    return heap.used_heap_size() + js_gc_freed;
+}
+
+// Per-block measurements of a js~ object's perform calls.
+// Heap allocation is measured around every js_dspstats_heap_period-th call.
+static const uint64_t js_dspstats_heap_period = 64;
+
+typedef struct _js_dspstats
+{
+    uint64_t blocks = 0;
+    uint64_t overruns = 0; // blocks where perform took longer than the block's duration
+    double last_us = 0;
+    double max_us = 0;
+    double total_us = 0;
+    uint64_t heap_samples = 0; // perform calls whose heap allocation was measured
+    uint64_t heap_bytes = 0; // bytes allocated on the JS heap during those calls
+    uint64_t buffers = 0; // ArrayBuffer backing stores allocated during perform
+    uint64_t gcs = 0; // garbage collections started during perform
+} t_js_dspstats;
+
+// Counters of a js object, output by the stats message.
+typedef struct _js_stats
+{
+    uint64_t messages = 0;
+    double total_us = 0; // in message handlers and timer callbacks
+    double max_us = 0;
+    uint64_t outlets = 0; // outlet calls
+    uint64_t atoms_in = 0; // atoms passed to message handlers
+    uint64_t atoms_out = 0; // atoms sent to outlets
+    double compile_us = 0; // loading the script the last time
+} t_js_stats;
+
+// A pending setTimeout/setInterval callback or a scheduled Task.
+typedef struct _js_timer
+{
+    struct _js* owner;
+    uint32_t id;
+    double due; // logical time of the next call
+    uint64_t seq; // orders timers due at the same time
+    struct _js_timer** slot; // the timer wheel list holding it, if any
+    struct _js_timer* prev;
+    struct _js_timer* next;
+    bool ready; // in js_timer_ready
+    bool cancelled; // cleared while in js_timer_ready, freed when popped
+    double interval;
+    int remaining; // calls left, -1 for no limit
+    v8::Global<v8::Function> func;
+    vector<v8::Global<v8::Value>> args;
+    v8::Global<v8::Object> task; // the Task to run instead of func
+} t_js_timer;
+
 typedef struct _js
 {
     t_object x_obj;
@@ -35,7 +202,28 @@ typedef struct _js
     v8::Persistent<v8::Context>* context;
     vector<t_atom> args;
     int inlet = 0;
-    string messagename;
+    const t_symbol* messagename = &s_;
+    uint32_t outlet_handles = 0;
+    int typedlists = 0;
+    unordered_map<uint32_t, t_js_timer*> timers;
+    uint32_t timer_id = 0;
+    bool profiling = false; // a CPU profile titled by js_profile_title(x) is running
+
+    // js~ only: inlets and outlets are signal inlets and outlets
+    bool signal = false;
+    t_float signal_f = 0;
+    vector<_inlet*> signal_inlets; // after the main signal inlet
+    vector<_outlet*> signal_outlets;
+    vector<t_sample*> signal_out;
+    int signal_n = 0;
+    double block_us = 0;
+    bool performing = false;
+    t_js_dspstats dspstats;
+    t_js_stats stats;
+    vector<v8::Global<v8::ArrayBuffer>> signal_buffers;
+    v8::Global<v8::Array> signal_inputs;
+    v8::Global<v8::Array> signal_outputs;
+    v8::Global<v8::Function> perform;
 } t_js;
 
 typedef struct _js_inlet
@@ -46,43 +234,378 @@ typedef struct _js_inlet
     _inlet* inlet;
 } t_js_inlet;
 
-typedef struct _js_weakcallbackinfo
-{
-    t_js* x;
-    v8::Persistent<v8::Object>* jso;
-} t_js_weakcallbackinfo;
-
 static string js_object_to_string(v8::Isolate* isolate, v8::Local<v8::Value> value)
 {
     v8::String::Utf8Value utf8_value(isolate, value);
     return utf8_value.length() > 0 ? string(*utf8_value) : string();
 }
 
-// Reads a file into a v8 string.
-static v8::MaybeLocal<v8::String> js_readfile(v8::Isolate* isolate, const char *name) {
+// Cache between Pd symbols and internalized V8 strings in both directions. Pd never
+// frees symbols, so entries are kept until the cache reaches js_symbols_max.
+static unordered_map<const t_symbol*, v8::Eternal<v8::String>> js_symbol_strings;
+// Cached symbols by the hash of their string, to find the symbol for a V8 string.
+static unordered_multimap<int, t_symbol*> js_string_symbols;
+static const size_t js_symbols_max = 1 << 16;
+
+static v8::Local<v8::String> js_symbol_string(v8::Isolate* isolate, const t_symbol* sym)
+{
+    auto it = js_symbol_strings.find(sym);
+
+    if (it != js_symbol_strings.end())
+        return it->second.Get(isolate);
+
+    v8::Local<v8::String> str;
+
+    if (!v8::String::NewFromUtf8(isolate, sym->s_name, v8::NewStringType::kInternalized).ToLocal(&str))
+        return v8::String::Empty(isolate);
+
+    if (js_symbol_strings.size() < js_symbols_max)
+    {
+        js_symbol_strings.emplace(sym, v8::Eternal<v8::String>(isolate, str));
+        js_string_symbols.emplace(str->GetIdentityHash(), (t_symbol*)sym);
+    }
+
+    return str;
+}
+
+static t_symbol* js_string_symbol(v8::Isolate* isolate, v8::Local<v8::String> str)
+{
+    auto range = js_string_symbols.equal_range(str->GetIdentityHash());
+
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (js_symbol_strings[it->second].Get(isolate)->StrictEquals(str))
+            return it->second;
+    }
+
+    auto sym = gensym(js_object_to_string(isolate, str).c_str());
+    js_symbol_string(isolate, sym);
+
+    return sym;
+}
+
+// The symbol for value, going through the cache for strings.
+static t_symbol* js_value_symbol(v8::Isolate* isolate, v8::Local<v8::Value> value)
+{
+    if (value->IsString())
+        return js_string_symbol(isolate, v8::Local<v8::String>::Cast(value));
+
+    return gensym(js_object_to_string(isolate, value).c_str());
+}
+
+// Reads a file into a string.
+static bool js_readfile(const char *name, string& contents) {
     FILE* file = fopen(name, "rb");
-    if (file == NULL) return v8::MaybeLocal<v8::String>();
+    if (file == NULL) return false;
 
     fseek(file, 0, SEEK_END);
     size_t size = ftell(file);
     rewind(file);
-    auto chars = std::make_unique<char[]>(size + 1);
-    chars.get()[size] = '\0';
+    contents.resize(size);
     for (size_t i = 0; i < size;) {
-        i += fread(&chars.get()[i], 1, size - i, file);
+        i += fread(&contents[i], 1, size - i, file);
         if (ferror(file)) {
             fclose(file);
-            return v8::MaybeLocal<v8::String>();
+            return false;
         }
     }
     fclose(file);
-    v8::MaybeLocal<v8::String> result = v8::String::NewFromUtf8(
-        isolate, chars.get(), v8::NewStringType::kNormal, static_cast<int>(size));
-    return result;
+    return true;
+}
+
+static v8::MaybeLocal<v8::String> js_new_string(v8::Isolate* isolate, const string& str)
+{
+    return v8::String::NewFromUtf8(isolate, str.data(), v8::NewStringType::kNormal, static_cast<int>(str.size()));
+}
+
+static bool js_mkdir(const string& dir)
+{
+    struct stat st;
+
+    if (stat(dir.c_str(), &st) == 0)
+        return (st.st_mode & S_IFDIR) != 0;
+
+    auto sep = dir.find_last_of("/\\");
+
+    if (sep != string::npos && sep > 0 && !js_mkdir(dir.substr(0, sep)))
+        return false;
+
+#if WIN32
+    return _mkdir(dir.c_str()) == 0;
+#else
+    return mkdir(dir.c_str(), 0755) == 0;
+#endif
+}
+
+// Directory for V8 code caches, empty if it can't be used.
+static const string& js_code_cache_dir()
+{
+    static bool init = false;
+    static string dir;
+
+    if (!init)
+    {
+        init = true;
+#if WIN32
+        auto base = getenv("LOCALAPPDATA");
+        if (base != NULL) dir = string(base) + "/pdjs/cache";
+#elif __APPLE__
+        auto base = getenv("HOME");
+        if (base != NULL) dir = string(base) + "/Library/Caches/pdjs";
+#else
+        auto base = getenv("XDG_CACHE_HOME");
+        if (base != NULL && base[0] != '\0') dir = string(base) + "/pdjs";
+        else if ((base = getenv("HOME")) != NULL) dir = string(base) + "/.cache/pdjs";
+#endif
+        if (!dir.empty() && !js_mkdir(dir))
+        {
+            verbose(1, "pdjs: code cache directory '%s' can't be created", dir.c_str());
+            dir.clear();
+        }
+    }
+
+    return dir;
+}
+
+// One cache file per script path and kind. The header records the V8 version and a hash
+// of the source, so caches from other versions or of changed files are never consumed.
+static string js_code_cache_file(const string& path, js_cache_kind kind)
+{
+    auto& dir = js_code_cache_dir();
+
+    if (dir.empty())
+        return string();
+
+    ostringstream os;
+    os << dir << "/" << hex << setw(16) << setfill('0') << std::hash<string>()(path)
+        << (kind == JS_CACHE_SCRIPT ? ".script" : kind == JS_CACHE_FUNCTION ? ".function" : kind == JS_CACHE_MODULE ? ".module" : ".esmodule");
+    return os.str();
+}
+
+static string js_code_cache_header(size_t hash)
+{
+    ostringstream os;
+    os << "pdjs code cache\n" << V8_VERSION_STRING << "\n" << hex << hash << "\n";
+    return os.str();
+}
+
+static v8::ScriptCompiler::CachedData* js_read_code_cache(const string& path, js_cache_kind kind, size_t hash)
+{
+    auto file = js_code_cache_file(path, kind);
+    string contents;
+
+    if (file.empty() || !js_readfile(file.c_str(), contents))
+        return nullptr;
+
+    auto header = js_code_cache_header(hash);
+
+    if (contents.size() <= header.size() || contents.compare(0, header.size(), header) != 0)
+        return nullptr;
+
+    auto length = contents.size() - header.size();
+    auto data = new uint8_t[length];
+    memcpy(data, contents.data() + header.size(), length);
+
+    return new v8::ScriptCompiler::CachedData(data, (int)length, v8::ScriptCompiler::CachedData::BufferOwned);
+}
+
+static void js_write_code_cache(const string& path, js_cache_kind kind, size_t hash, v8::ScriptCompiler::CachedData* data)
+{
+    unique_ptr<v8::ScriptCompiler::CachedData> cache(data);
+    auto file = js_code_cache_file(path, kind);
+
+    if (file.empty() || cache == nullptr || cache->length <= 0)
+        return;
+
+    // write to a temporary file first so a concurrent reader never sees half a cache
+    auto tmp = file + ".tmp";
+    auto header = js_code_cache_header(hash);
+    FILE* f = fopen(tmp.c_str(), "wb");
+
+    if (f == NULL)
+        return;
+
+    auto ok = fwrite(header.data(), 1, header.size(), f) == header.size()
+        && fwrite(cache->data, 1, cache->length, f) == (size_t)cache->length;
+
+    fclose(f);
+    remove(file.c_str());
+
+    if (!ok || rename(tmp.c_str(), file.c_str()) != 0)
+        remove(tmp.c_str());
+}
+
+// The watchdog thread terminates a call into JS that runs longer than js_watch_timeout
+// ms, so a runaway script costs one message instead of blocking Pd's scheduler. Calls
+// nested in the outermost one (e.g. through outlets into other js objects) share its
+// deadline; loading a script or module gets at least js_watch_load_timeout ms. The
+// outermost caller reports the error and cancels the termination. Arming only stores
+// an atomic deadline, so perform never takes a lock.
+static std::atomic<double> js_watch_timeout(1000); // 0 disables the watchdog
+static std::atomic<double> js_watch_load_timeout(10000);
+// steady_clock ticks at which the running call is terminated, 0 if it has none and
+// -1 once the watchdog (or js_near_heap_limit) has claimed it
+static std::atomic<int64_t> js_watch_deadline(0);
+static std::atomic<bool> js_watch_fired(false); // TerminateExecution has been called
+static std::chrono::steady_clock::time_point js_watch_start;
+static double js_watch_limit = 0; // the timeout of the running call, for the error message
+static int js_watch_depth = 0;
+static bool js_heap_exceeded = false; // terminated by js_near_heap_limit, not the timeout
+
+static void js_watch_run()
+{
+    while (true)
+    {
+        auto deadline = js_watch_deadline.load();
+
+        // the main thread clears the deadline when the call returns, so claiming it
+        // with the exchange makes sure the termination hits that call
+        if (deadline > 0 && std::chrono::steady_clock::now().time_since_epoch().count() > deadline
+            && js_watch_deadline.compare_exchange_strong(deadline, -1))
+        {
+            js_isolate->TerminateExecution();
+            js_watch_fired = true;
+        }
+
+        // polling keeps arming free of notifications, at most a tenth of the timeout late
+        double timeout = js_watch_timeout;
+        auto period = timeout > 0 ? std::min(std::max(timeout / 10, 1.0), 50.0) : 50.0;
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(period));
+    }
+}
+
+static void js_watch_arm(double timeout)
+{
+    auto now = std::chrono::steady_clock::now();
+
+    if (js_watch_depth++ == 0)
+    {
+        js_watch_start = now;
+        js_watch_limit = timeout;
+        js_watch_deadline = timeout > 0 ? (now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(timeout))).time_since_epoch().count() : 0;
+        return;
+    }
+
+    auto elapsed = std::chrono::duration<double, std::milli>(now - js_watch_start).count();
+    int64_t deadline = js_watch_deadline;
+
+    // a nested load may only push the deadline of the running call back
+    if (timeout > 0 && deadline > 0 && elapsed + timeout > js_watch_limit)
+    {
+        auto extended = (now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(timeout))).time_since_epoch().count();
+
+        if (js_watch_deadline.compare_exchange_strong(deadline, extended))
+            js_watch_limit = elapsed + timeout;
+    }
+}
+
+static void js_watch_begin()
+{
+    js_watch_arm(js_watch_timeout);
+}
+
+// Loading scripts and modules may take longer than a message.
+static void js_watch_load_begin()
+{
+    js_watch_arm(js_watch_load_timeout);
+}
+
+// Posts the contexts using the most memory, measured asynchronously by V8.
+class js_heap_report : public v8::MeasureMemoryDelegate
+{
+public:
+    const char* title;
+    size_t count;
+
+    js_heap_report(const char* title, size_t count) : title(title), count(count) {}
+
+    bool ShouldMeasure(v8::Local<v8::Context> context) override
+    {
+        return true;
+    }
+
+    void MeasurementComplete(const std::vector<std::pair<v8::Local<v8::Context>, size_t>>& context_sizes,
+        size_t unattributed_size) override
+    {
+        auto sizes = context_sizes;
+
+        std::sort(sizes.begin(), sizes.end(),
+            [](const std::pair<v8::Local<v8::Context>, size_t>& a, const std::pair<v8::Local<v8::Context>, size_t>& b) { return a.second > b.second; });
+
+        post("js: %s:", title);
+
+        for (size_t i = 0; i < sizes.size() && i < count; i++)
+        {
+            auto x = (struct _js*)sizes[i].first->GetAlignedPointerFromEmbedderData(js_context_owner);
+            post("  %s: %zu KB", !js_module_context.IsEmpty() && sizes[i].first == js_module_context.Get(js_isolate) ? "(modules)"
+                : x == nullptr ? "(deleted)" : x->path.empty() ? "(no script)" : x->path.c_str(), sizes[i].second >> 10);
+        }
+
+        post("  shared: %zu KB", unattributed_size >> 10);
+    }
+};
+
+static void js_watch_end()
+{
+    if (--js_watch_depth > 0)
+        return;
+
+    if (js_watch_deadline.exchange(0) == -1)
+    {
+        // claimed, wait for the watchdog to have terminated before cancelling
+        while (!js_watch_fired)
+            std::this_thread::yield();
+
+        js_watch_fired = false;
+        js_isolate->CancelTerminateExecution();
+    }
+
+    if (js_heap_exceeded)
+    {
+        js_heap_exceeded = false;
+        js_isolate->LowMemoryNotification();
+        js_isolate->MeasureMemory(std::unique_ptr<v8::MeasureMemoryDelegate>(new js_heap_report("heaviest contexts after the collection", 5)),
+            v8::MeasureMemoryExecution::kEager);
+    }
+}
+
+// Called by V8 before it would abort Pd for running out of heap. Terminates the running
+// script and lends it headroom to unwind, up to twice the configured limit; V8 restores
+// the limit once the heap has shrunk again.
+static size_t js_near_heap_limit(void* data, size_t current_heap_limit, size_t initial_heap_limit)
+{
+    pd_error(NULL, "js: the JavaScript heap reached its limit of %zu MB.", current_heap_limit >> 20);
+
+    if (js_watch_depth > 0)
+    {
+        js_heap_exceeded = true;
+
+        if (js_watch_deadline.exchange(-1) != -1)
+        {
+            js_isolate->TerminateExecution();
+            js_watch_fired = true;
+        }
+    }
+
+    if (current_heap_limit >= 2 * initial_heap_limit)
+        return current_heap_limit;
+
+    return current_heap_limit + std::max(initial_heap_limit / 4, (size_t)16 << 20);
 }
 
 static string js_get_exception_msg(v8::Isolate* isolate, const v8::TryCatch* try_catch) {
     v8::HandleScope handle_scope(isolate);
+    if (try_catch->HasTerminated() && js_heap_exceeded) {
+        return "Terminated for using too much memory.\n";
+    }
+    if (try_catch->HasTerminated()) {
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - js_watch_start).count();
+        ostringstream os;
+        os << "Terminated after " << (long)ms << " ms, the timeout is " << js_watch_limit << " ms.\n";
+        return os.str();
+    }
     v8::String::Utf8Value exception(isolate, try_catch->Exception());
     const char* exception_string = *exception;
     v8::Local<v8::Message> message = try_catch->Message();
@@ -139,9 +662,7 @@ static v8::MaybeLocal<v8::Value> js_marshal_atom(const t_atom* atom)
     }
     else if (type == A_SYMBOL)
     {
-        v8::Local<v8::String> s;
-        if (v8::String::NewFromUtf8(js_isolate, atom_getsymbol(atom)->s_name).ToLocal(&s))
-            return s;
+        return js_symbol_string(js_isolate, atom_getsymbol(atom));
     }
 
     return v8::Local<v8::Value>();
@@ -149,21 +670,21 @@ static v8::MaybeLocal<v8::Value> js_marshal_atom(const t_atom* atom)
 
 static v8::MaybeLocal<v8::Value> js_marshal_object(const t_atom* a, const t_js* x)
 {
-    string ps(atom_getsymbol(a)->s_name);
-    try
+    if (a->a_type == A_FLOAT)
     {
-        auto p = stoull(ps);
-        auto jso = reinterpret_cast<v8::Persistent<v8::Object>*>(p);
-        if (jsobjects.find(jso) != jsobjects.end())
-            return jso->Get(js_isolate);
+        auto f = atom_getfloat(a);
+        auto id = (size_t)f;
+
+        if (id > 0 && id == f && id < jsobjects.size() && !jsobjects[id].IsEmpty())
+            return jsobjects[id].Get(js_isolate);
     }
-    catch (...) {}
 
     return v8::MaybeLocal<v8::Value>();
 }
 
 static vector<v8::Local<v8::Value>> js_marshal_args(int argc, const t_atom* argv, const t_js* x)
 {
+    static const t_symbol* jsobject = gensym("jsobject");
     vector<v8::Local<v8::Value>> args;
 
     for (int i = 0; i < argc; i++)
@@ -171,12 +692,12 @@ static vector<v8::Local<v8::Value>> js_marshal_args(int argc, const t_atom* argv
         v8::Local<v8::Value> val;
         auto atom = argv[i];
 
-        if (atom.a_type == A_SYMBOL && atom.a_w.w_symbol == gensym("jsobject")
-            && i < (argc - 1) && argv[i + 1].a_type == A_SYMBOL
-            && js_marshal_object(&argv[i + 1], x).ToLocal(&val))
+        if (atom.a_type == A_SYMBOL && atom.a_w.w_symbol == jsobject
+            && i < (argc - 1) && js_marshal_object(&argv[i + 1], x).ToLocal(&val))
         {
             args.push_back(val);
             i++;
+            continue;
         }
 
         if (js_marshal_atom(&(argv[i])).ToLocal(&val))
@@ -188,119 +709,235 @@ static vector<v8::Local<v8::Value>> js_marshal_args(int argc, const t_atom* argv
     return args;
 }
 
-static void js_get(v8::Local<v8::Name> property,
-    const v8::PropertyCallbackInfo<v8::Value>& info)
+template <typename T, typename A>
+static v8::Local<v8::Value> js_marshal_typed(int argc, const t_atom* argv)
 {
-    v8::Local<v8::External> f = v8::Local<v8::External>::Cast(info.Data());
-    auto x = (t_js*)f->Value();
-    auto name = js_object_to_string(js_isolate, property);
+    auto buffer = v8::ArrayBuffer::New(js_isolate, argc * sizeof(T));
+    auto data = (T*)buffer->GetBackingStore()->Data();
 
-    if (name == "inlets")
-    {
-        info.GetReturnValue().Set((int32_t)(x->inlets.size()));
-    }
-    else if (name == "outlets")
-    {
-        info.GetReturnValue().Set((int32_t)x->outlets.size());
-    }
-    else if (name == "inlet")
-    {
-        info.GetReturnValue().Set(x->inlet);
-    }
-    else if (name == "messagename")
-    {
-        v8::Local<v8::String> messagename;
-        if (v8::String::NewFromUtf8(js_isolate, x->messagename.c_str()).ToLocal(&messagename))
-        {
-            info.GetReturnValue().Set(messagename);
-        }
-    }
-    else if (name == "jsarguments")
-    {
-        vector<v8::Local<v8::Value>> args = js_marshal_args((int)x->args.size(), x->args.data(), x);
-        info.GetReturnValue().Set(v8::Array::New(js_isolate, args.data(), args.size()));
-    }
-    else if (name == "__global__")
-    {
-        info.GetReturnValue().Set(js_global->Get(js_isolate));
-    }
+    for (int i = 0; i < argc; i++)
+        data[i] = (T)argv[i].a_w.w_float;
+
+    return A::New(buffer, 0, argc);
 }
 
-static void js_set_inlets(t_js* x, int inlets)
+// A list of floats as a single Float32Array (Float64Array if bits is 64).
+// Returns an empty handle if the list is empty or not all numeric.
+static v8::Local<v8::Value> js_marshal_typed(int argc, const t_atom* argv, int bits)
 {
-    if (inlets < 1) inlets = 1;
+    if (argc < 1)
+        return v8::Local<v8::Value>();
 
-    if ((int)x->inlets.size() > inlets)
-    {
-        for (auto i = inlets; i < (int)x->inlets.size(); i++)
-        {
-            inlet_free(x->inlets[i]->inlet);
-        }
+    for (int i = 0; i < argc; i++)
+        if (argv[i].a_type != A_FLOAT)
+            return v8::Local<v8::Value>();
 
-        x->inlets.resize(inlets);
-    }
-    else if ((int)x->inlets.size() < inlets)
-    {
-        for (auto i = (int)x->inlets.size(); i < inlets; i++)
-        {
-            auto inlet = (t_js_inlet*)getbytes(sizeof(t_js_inlet));
-            inlet->pd = js_inlet_class;
-            inlet->owner = x;
-            inlet->index = i;
-            inlet->inlet = inlet_new(&x->x_obj, &inlet->pd, 0, 0);
-            x->inlets.push_back(inlet);
-        }
-    }
+    if (bits == 64)
+        return js_marshal_typed<double, v8::Float64Array>(argc, argv);
+    else
+        return js_marshal_typed<float, v8::Float32Array>(argc, argv);
 }
 
-static void js_set_outlets(t_js* x, int outlets)
+static void js_inlets_getter(v8::Local<v8::Name> property,
+    const v8::PropertyCallbackInfo<v8::Value>& info)
 {
-    if (outlets < 0) outlets = 0;
-
-    if ((int)x->outlets.size() > outlets)
-    {
-        for (int i = outlets; i < (int)x->outlets.size(); i++)
-        {
-            outlet_free(x->outlets[i]);
-        }
+    v8::Local<v8::External> f = v8::Local<v8::External>::Cast(info.Data());
+    auto x = (t_js*)f->Value();
+    info.GetReturnValue().Set((int32_t)(x->signal ? 1 + x->signal_inlets.size() : x->inlets.size()));
+}
 
-        x->outlets.resize(outlets);
-    }
-    else if ((int)x->outlets.size() < outlets)
-    {
-        for (auto i = (int)x->outlets.size(); i < outlets; i++)
-        {
-            auto outlet = outlet_new(&x->x_obj, 0);
-            x->outlets.push_back(outlet);
-        }
-    }
+static void js_outlets_getter(v8::Local<v8::Name> property,
+    const v8::PropertyCallbackInfo<v8::Value>& info)
+{
+    v8::Local<v8::External> f = v8::Local<v8::External>::Cast(info.Data());
+    auto x = (t_js*)f->Value();
+    info.GetReturnValue().Set((int32_t)(x->signal ? x->signal_outlets.size() : x->outlets.size()));
 }
 
-static void js_set(v8::Local<v8::Name> property, v8::Local<v8::Value> value,
+static void js_inlet_getter(v8::Local<v8::Name> property,
     const v8::PropertyCallbackInfo<v8::Value>& info)
 {
     v8::Local<v8::External> f = v8::Local<v8::External>::Cast(info.Data());
     auto x = (t_js*)f->Value();
-    auto name = js_object_to_string(js_isolate, property);
+    info.GetReturnValue().Set(x->inlet);
+}
 
-    if (name == "inlets")
-    {
-        int inlets;
+static void js_messagename_getter(v8::Local<v8::Name> property,
+    const v8::PropertyCallbackInfo<v8::Value>& info)
+{
+    v8::Local<v8::External> f = v8::Local<v8::External>::Cast(info.Data());
+    auto x = (t_js*)f->Value();
+    info.GetReturnValue().Set(js_symbol_string(js_isolate, x->messagename));
+}
+
+static void js_typedlists_getter(v8::Local<v8::Name> property,
+    const v8::PropertyCallbackInfo<v8::Value>& info)
+{
+    v8::Local<v8::External> f = v8::Local<v8::External>::Cast(info.Data());
+    auto x = (t_js*)f->Value();
+    info.GetReturnValue().Set(x->typedlists);
+}
+
+static void js_typedlists_setter(v8::Local<v8::Name> property, v8::Local<v8::Value> value,
+    const v8::PropertyCallbackInfo<void>& info)
+{
+    v8::Local<v8::External> f = v8::Local<v8::External>::Cast(info.Data());
+    auto x = (t_js*)f->Value();
+    int32_t bits;
+
+    if (value->Int32Value(info.GetIsolate()->GetCurrentContext()).To(&bits))
+        x->typedlists = bits;
+}
+
+static void js_jsarguments_getter(v8::Local<v8::Name> property,
+    const v8::PropertyCallbackInfo<v8::Value>& info)
+{
+    v8::Local<v8::External> f = v8::Local<v8::External>::Cast(info.Data());
+    auto x = (t_js*)f->Value();
+    vector<v8::Local<v8::Value>> args = js_marshal_args((int)x->args.size(), x->args.data(), x);
+    info.GetReturnValue().Set(v8::Array::New(js_isolate, args.data(), args.size()));
+}
+
+static t_js_inlet* js_new_inlet(t_js* x, int index)
+{
+    auto inlet = (t_js_inlet*)getbytes(sizeof(t_js_inlet));
+    inlet->pd = js_inlet_class;
+    inlet->owner = x;
+    inlet->index = index;
+    inlet->inlet = NULL;
+    return inlet;
+}
+
+// js~ has no control inlets. Messages arrive on the main signal inlet, which is
+// represented by a t_js_inlet without a Pd inlet.
+static void js_set_signal_inlets(t_js* x, int inlets)
+{
+    auto extra = (size_t)(inlets - 1);
+
+    if (x->inlets.empty())
+        x->inlets.push_back(js_new_inlet(x, 0));
+
+    if (extra == x->signal_inlets.size())
+        return;
+
+    while (x->signal_inlets.size() > extra)
+    {
+        inlet_free(x->signal_inlets.back());
+        x->signal_inlets.pop_back();
+    }
+
+    while (x->signal_inlets.size() < extra)
+        x->signal_inlets.push_back(inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal));
+
+    canvas_update_dsp();
+}
+
+static void js_set_signal_outlets(t_js* x, int outlets)
+{
+    auto count = (size_t)outlets;
+
+    if (count == x->signal_outlets.size())
+        return;
+
+    while (x->signal_outlets.size() > count)
+    {
+        outlet_free(x->signal_outlets.back());
+        x->signal_outlets.pop_back();
+    }
+
+    while (x->signal_outlets.size() < count)
+        x->signal_outlets.push_back(outlet_new(&x->x_obj, &s_signal));
+
+    canvas_update_dsp();
+}
+
+static void js_set_inlets(t_js* x, int inlets)
+{
+    if (inlets < 1) inlets = 1;
+
+    if (x->signal)
+    {
+        js_set_signal_inlets(x, inlets);
+        return;
+    }
+
+    if ((int)x->inlets.size() > inlets)
+    {
+        for (auto i = inlets; i < (int)x->inlets.size(); i++)
+        {
+            inlet_free(x->inlets[i]->inlet);
+        }
 
-        if (value->Int32Value(x->context->Get(js_isolate)).To(&inlets))
+        x->inlets.resize(inlets);
+    }
+    else if ((int)x->inlets.size() < inlets)
+    {
+        for (auto i = (int)x->inlets.size(); i < inlets; i++)
         {
-            js_set_inlets(x, inlets);
+            auto inlet = js_new_inlet(x, i);
+            inlet->inlet = inlet_new(&x->x_obj, &inlet->pd, 0, 0);
+            x->inlets.push_back(inlet);
         }
     }
-    else if (name == "outlets")
+}
+
+static void js_update_outlet_handles(t_js* x);
+
+static void js_set_outlets(t_js* x, int outlets)
+{
+    if (outlets < 0) outlets = 0;
+
+    if (x->signal)
+    {
+        js_set_signal_outlets(x, outlets);
+        return;
+    }
+
+    if ((int)x->outlets.size() > outlets)
     {
-        int outlets;
+        for (int i = outlets; i < (int)x->outlets.size(); i++)
+        {
+            outlet_free(x->outlets[i]);
+        }
 
-        if (value->Int32Value(x->context->Get(js_isolate)).To(&outlets))
+        x->outlets.resize(outlets);
+    }
+    else if ((int)x->outlets.size() < outlets)
+    {
+        for (auto i = (int)x->outlets.size(); i < outlets; i++)
         {
-            js_set_outlets(x, outlets);
+            auto outlet = outlet_new(&x->x_obj, 0);
+            x->outlets.push_back(outlet);
         }
     }
+
+    js_update_outlet_handles(x);
+}
+
+static void js_inlets_setter(v8::Local<v8::Name> property, v8::Local<v8::Value> value,
+    const v8::PropertyCallbackInfo<void>& info)
+{
+    v8::Local<v8::External> f = v8::Local<v8::External>::Cast(info.Data());
+    auto x = (t_js*)f->Value();
+    int inlets;
+
+    if (x->performing)
+        pd_error(&x->x_obj, "inlets can't be changed in perform.");
+    else if (value->Int32Value(x->context->Get(js_isolate)).To(&inlets))
+        js_set_inlets(x, inlets);
+}
+
+static void js_outlets_setter(v8::Local<v8::Name> property, v8::Local<v8::Value> value,
+    const v8::PropertyCallbackInfo<void>& info)
+{
+    v8::Local<v8::External> f = v8::Local<v8::External>::Cast(info.Data());
+    auto x = (t_js*)f->Value();
+    int outlets;
+
+    if (x->performing)
+        pd_error(&x->x_obj, "outlets can't be changed in perform.");
+    else if (value->Int32Value(x->context->Get(js_isolate)).To(&outlets))
+        js_set_outlets(x, outlets);
 }
 
 static void js_post(const v8::FunctionCallbackInfo<v8::Value>& args) {
@@ -362,74 +999,154 @@ static void js_error(const v8::FunctionCallbackInfo<v8::Value>& args) {
     pd_error(x, "%s", err.c_str());
 }
 
-static tuple<string, intptr_t> js_unmarshal_string(v8::Isolate* isolate, v8::Local<v8::Value> value, t_js* x = NULL)
+// Private symbol under which an object stores its jsobject id.
+static v8::Local<v8::Private> js_jsobject_key(v8::Isolate* isolate)
+{
+    static v8::Eternal<v8::Private> key;
+
+    if (key.IsEmpty())
+        key.Set(isolate, v8::Private::New(isolate, v8::String::NewFromUtf8Literal(isolate, "jsobject")));
+
+    return key.Get(isolate);
+}
+
+static uint32_t js_register_object(v8::Isolate* isolate, v8::Local<v8::Object> o, const t_js* x)
+{
+    auto context = isolate->GetCurrentContext();
+    v8::Local<v8::Value> val;
+    uint32_t id;
+
+    // objects that are already registered carry their id in a private property
+    if (o->GetPrivate(context, js_jsobject_key(isolate)).ToLocal(&val) && val->IsUint32()
+        && val->Uint32Value(context).To(&id))
+    {
+        return id;
+    }
+
+    if (!jsobjects_free.empty())
+    {
+        id = jsobjects_free.back();
+        jsobjects_free.pop_back();
+    }
+    else if (jsobjects.size() < jsobjects_max)
+    {
+        id = (uint32_t)jsobjects.size();
+        jsobjects.emplace_back();
+    }
+    else
+    {
+        pd_error(x, "Too many live jsobjects.");
+        return 0;
+    }
+
+    // if this fails the object simply gets a new id the next time it's passed
+    o->SetPrivate(context, js_jsobject_key(isolate), v8::Integer::NewFromUnsigned(isolate, id)).FromMaybe(false);
+
+    auto& jso = jsobjects[id];
+    jso.Reset(isolate, o);
+    jso.SetWeak(reinterpret_cast<void*>((uintptr_t)id), [](const v8::WeakCallbackInfo<void>& data)
+    {
+        auto id = (uint32_t)reinterpret_cast<uintptr_t>(data.GetParameter());
+        jsobjects[id].Reset();
+        jsobjects_free.push_back(id);
+    }, v8::WeakCallbackType::kParameter);
+
+    return id;
+}
+
+static tuple<t_symbol*, uint32_t> js_unmarshal_string(v8::Isolate* isolate, v8::Local<v8::Value> value, t_js* x = NULL)
 {
     if (value->IsString() || value->IsStringObject())
     {
-        return std::make_tuple(js_object_to_string(isolate, value), 0);
+        return std::make_tuple(js_value_symbol(isolate, value), 0);
     }
     else if (value->IsObject())
     {
-        // check if we already have a persistent handle to this object in the set
-        for (auto elem : jsobjects)
-        {
-            if (value == elem->Get(isolate))
-            {
-                return std::make_tuple(string("jsobject"), reinterpret_cast<intptr_t>(elem));
-            }
-        }
+        auto id = js_register_object(isolate, v8::Local<v8::Object>::Cast(value), x);
 
-        auto o = v8::Local<v8::Object>::Cast(value);
-        auto jso = new v8::Persistent<v8::Object>(js_isolate, o);
-        auto wcbi = new t_js_weakcallbackinfo();
+        if (id > 0)
+            return std::make_tuple(gensym("jsobject"), id);
+    }
+
+    return std::make_tuple(&s_, 0);
+}
 
-        wcbi->x = x;
-        wcbi->jso = jso;
+// The elements of a typed array in its backing store.
+template <typename T>
+static T* js_typed_data(v8::Local<v8::TypedArray> array)
+{
+    return (T*)((char*)array->Buffer()->GetBackingStore()->Data() + array->ByteOffset());
+}
 
-        jsobjects.insert(jso);
+template <typename T>
+static void js_unmarshal_typed(v8::Local<v8::TypedArray> array, t_atom* atoms)
+{
+    auto n = array->Length();
+    auto data = js_typed_data<const T>(array);
 
-        jso->SetWeak(wcbi, [](const v8::WeakCallbackInfo<t_js_weakcallbackinfo>& data)
-        {
-            auto wcbi = data.GetParameter();
-            if (wcbi != nullptr)
-            {
-                jsobjects.erase(wcbi->jso);
-                if (wcbi->jso != nullptr)
-                    delete wcbi->jso;
-                delete wcbi;
-            }
-        }, v8::WeakCallbackType::kParameter);
+    for (size_t i = 0; i < n; i++)
+        SETFLOAT(&atoms[i], (t_float)data[i]);
+}
 
-        return std::make_tuple(string("jsobject"), reinterpret_cast<intptr_t>(jso));
-    }
+// Fills atoms from a Float32Array, Float64Array or Int32Array in one loop over the
+// backing store. Returns false for other values.
+static bool js_unmarshal_typed(v8::Local<v8::Value> arg, t_atom* atoms)
+{
+    if (arg->IsFloat32Array())
+        js_unmarshal_typed<float>(v8::Local<v8::TypedArray>::Cast(arg), atoms);
+    else if (arg->IsFloat64Array())
+        js_unmarshal_typed<double>(v8::Local<v8::TypedArray>::Cast(arg), atoms);
+    else if (arg->IsInt32Array())
+        js_unmarshal_typed<int32_t>(v8::Local<v8::TypedArray>::Cast(arg), atoms);
+    else
+        return false;
 
-    return std::make_tuple(string(), 0);
+    return true;
 }
 
-static vector<t_atom> js_unmarshal_arg(v8::Local<v8::Value> arg, v8::Isolate* isolate, v8::Local<v8::Context> context, t_js* x)
+static bool js_is_bulk_typed(v8::Local<v8::Value> arg)
 {
-    vector<t_atom> args;
+    return arg->IsFloat32Array() || arg->IsFloat64Array() || arg->IsInt32Array();
+}
 
+// Appends the atoms for arg to argv. Numbers inside arrays are appended directly,
+// only nested arrays and objects recurse.
+static void js_unmarshal_arg(v8::Local<v8::Value> arg, v8::Isolate* isolate, v8::Local<v8::Context> context, t_js* x, vector<t_atom>& argv)
+{
     if (arg->IsNumber())
     {
-        double num;
-        if (arg->NumberValue(context).To(&num))
-        {
-            t_atom a = {};
-            SETFLOAT(&a, (t_float)num);
-            args.push_back(a);
-        }
+        t_atom a = {};
+        SETFLOAT(&a, (t_float)v8::Local<v8::Number>::Cast(arg)->Value());
+        argv.push_back(a);
+    }
+    else if (js_is_bulk_typed(arg))
+    {
+        auto offset = argv.size();
+        argv.resize(offset + v8::Local<v8::TypedArray>::Cast(arg)->Length());
+        js_unmarshal_typed(arg, &argv[offset]);
     }
     else if (arg->IsArray())
     {
         auto array = v8::Local<v8::Array>::Cast(arg);
-        for (uint32_t i = 0; i < array->Length(); i++)
+        auto n = array->Length();
+
+        argv.reserve(argv.size() + n);
+
+        for (uint32_t i = 0; i < n; i++)
         {
             v8::Local<v8::Value> subval;
-            if (array->Get(context, i).ToLocal(&subval))
+            if (!array->Get(context, i).ToLocal(&subval))
+                continue;
+
+            if (subval->IsNumber())
+            {
+                t_atom a = {};
+                SETFLOAT(&a, (t_float)v8::Local<v8::Number>::Cast(subval)->Value());
+                argv.push_back(a);
+            }
+            else
             {
-                auto subs = js_unmarshal_arg(subval, isolate, context, x);
-                args.insert(args.end(), subs.begin(), subs.end());
+                js_unmarshal_arg(subval, isolate, context, x, argv);
             }
         }
     }
@@ -438,20 +1155,18 @@ static vector<t_atom> js_unmarshal_arg(v8::Local<v8::Value> arg, v8::Isolate* is
         auto t = js_unmarshal_string(isolate, arg, x);
 
         t_atom a = {};
-        SETSYMBOL(&a, gensym(get<0>(t).c_str()));
-        args.push_back(a);
+        SETSYMBOL(&a, get<0>(t));
+        argv.push_back(a);
 
         auto p = get<1>(t);
 
         if (p > 0)
         {
             t_atom ap = {};
-            SETSYMBOL(&ap, gensym(to_string(p).c_str()));
-            args.push_back(ap);
+            SETFLOAT(&ap, (t_float)p);
+            argv.push_back(ap);
         }
     }
-
-    return args;
 }
 
 static vector<t_atom> js_unmarshal_args(vector<v8::Local<v8::Value>> &args, v8::Isolate* isolate, v8::Local<v8::Context> context, t_js* x)
@@ -459,11 +1174,7 @@ static vector<t_atom> js_unmarshal_args(vector<v8::Local<v8::Value>> &args, v8::
     vector<t_atom> argv;
 
     for (int i = 0; i < (int)args.size(); i++)
-    {
-        v8::Local<v8::Value> arg = args[i];
-        auto uma = js_unmarshal_arg(arg, isolate, context, x);
-        argv.insert(argv.end(), uma.begin(), uma.end());
-    }
+        js_unmarshal_arg(args[i], isolate, context, x, argv);
 
     return argv;
 }
@@ -481,7 +1192,7 @@ static t_symbol* js_get_type(vector<t_atom> &argv)
             type = &s_float;
             break;
         case A_SYMBOL:
-            if (first.a_w.w_symbol == gensym("bang"))
+            if (first.a_w.w_symbol == &s_bang)
                 type = &s_bang;
             else
                 type = first.a_w.w_symbol;
@@ -493,7 +1204,7 @@ static t_symbol* js_get_type(vector<t_atom> &argv)
     }
     else
     {
-        if (first.a_type != A_SYMBOL || first.a_w.w_symbol == gensym("list"))
+        if (first.a_type != A_SYMBOL || first.a_w.w_symbol == &s_list)
             type = &s_list;
         else
             type = first.a_w.w_symbol;
@@ -502,6 +1213,12 @@ static t_symbol* js_get_type(vector<t_atom> &argv)
     return type;
 }
 
+static void js_count_outlet(t_js* x, size_t atoms)
+{
+    x->stats.outlets++;
+    x->stats.atoms_out += atoms;
+}
+
 static void js_outlet_args(_outlet* outlet, vector<v8::Local<v8::Value>> &args, t_js* x)
 {
     v8::Isolate* isolate = js_isolate;
@@ -509,6 +1226,8 @@ static void js_outlet_args(_outlet* outlet, vector<v8::Local<v8::Value>> &args,
 
     auto argv = js_unmarshal_args(args, isolate, context, x);
 
+    js_count_outlet(x, argv.size());
+
     if (!argv.empty())
     {
         auto type = js_get_type(argv);
@@ -535,9 +1254,18 @@ static void js_outlet(const v8::FunctionCallbackInfo<v8::Value>& args)
     int32_t outlet_num;
 
     if (args[0]->Int32Value(context).To(&outlet_num)
-        && outlet_num < (int32_t)x->outlets.size())
+        && outlet_num >= 0 && outlet_num < (int32_t)x->outlets.size())
     {
         _outlet* outlet = x->outlets[outlet_num];
+
+        // single numbers are by far the most common case
+        if (args.Length() == 2 && args[1]->IsNumber())
+        {
+            js_count_outlet(x, 1);
+            outlet_float(outlet, (t_float)v8::Local<v8::Number>::Cast(args[1])->Value());
+            return;
+        }
+
         vector<v8::Local<v8::Value>> argv;
 
         for (int i = 1; i < args.Length(); i++)
@@ -553,129 +1281,1805 @@ static void js_outlet(const v8::FunctionCallbackInfo<v8::Value>& args)
     }
 }
 
-static void js_messnamed(const v8::FunctionCallbackInfo<v8::Value>& args)
+// Atom storage that stays on the stack for short lists, like Pd's ATOMS_ALLOCA.
+struct js_atom_buffer
 {
-    if (args.Length() < 1) return;
+    static const size_t small_size = 64;
+    t_atom small[small_size];
+    vector<t_atom> large;
+    t_atom* atoms;
 
-    v8::Isolate* isolate = args.GetIsolate();
-    v8::HandleScope scope(isolate);
-    v8::Local<v8::Context> context = isolate->GetCurrentContext();
-    v8::Local<v8::String> symbolString;
-    v8::Local<v8::External> f = v8::Local<v8::External>::Cast(args.Data());
-    auto x = (t_js*)f->Value();
+    js_atom_buffer(size_t n) : atoms(n <= small_size ? small : (large.resize(n), large.data())) {}
+};
 
-    if (args[0]->ToString(context).ToLocal(&symbolString))
-    {
-        auto symbol = js_object_to_string(js_isolate, symbolString);
-        t_symbol *sym = gensym(symbol.c_str());
+// Only scalars map to a single atom, false for arrays and objects.
+static bool js_set_atom(t_atom* a, v8::Local<v8::Value> value)
+{
+    if (value->IsNumber())
+        SETFLOAT(a, (t_float)v8::Local<v8::Number>::Cast(value)->Value());
+    else if (value->IsObject())
+        return false;
+    else
+        SETSYMBOL(a, js_value_symbol(js_isolate, value));
 
-        if (sym->s_thing != NULL)
-        {
-            vector<t_atom> argv;
+    return true;
+}
 
-            for (int i = 1; i < args.Length(); i++)
-            {
-                v8::Local<v8::Value> arg = args[i];
-                auto uma = js_unmarshal_arg(arg, isolate, context, x);
-                argv.insert(argv.end(), uma.begin(), uma.end());
-            }
+// Handles keep the instance in internal field 0 and the outlet index in field 1.
+// The index is stored shifted as an aligned pointer so reading it doesn't allocate a handle.
+static void* js_handle_index(uint32_t index)
+{
+    return reinterpret_cast<void*>((uintptr_t)index << 1);
+}
 
-            if (!argv.empty())
-            {
-                auto type = js_get_type(argv);
+// The outlet behind a handle from outlet[n], NULL if the outlet has been removed.
+// Counts a call sending atoms atoms.
+static _outlet* js_handle_outlet(const v8::FunctionCallbackInfo<v8::Value>& args, size_t atoms)
+{
+    auto holder = args.Holder();
+    auto x = (t_js*)holder->GetAlignedPointerFromInternalField(0);
+    auto index = reinterpret_cast<uintptr_t>(holder->GetAlignedPointerFromInternalField(1)) >> 1;
 
-                if (type != NULL)
-                {
-                    if (type == argv[0].a_w.w_symbol)
-                        argv.erase(argv.begin());
+    if (index >= x->outlets.size())
+        return NULL;
 
-                    pd_typedmess(sym->s_thing, type, (int)argv.size(), argv.data());
-                }
-            }
-        }
-    }
+    js_count_outlet(x, atoms);
+    return x->outlets[index];
 }
 
-struct js_file
+// Sets a list element, reports nested arrays and objects instead of sending their string.
+static bool js_handle_atom(const v8::FunctionCallbackInfo<v8::Value>& args, const char* method, t_atom* a, v8::Local<v8::Value> value, int index)
 {
-    string path;
-    string dir;
-};
+    if (js_set_atom(a, value))
+        return true;
 
-static js_file js_getfile(const t_js *x, const char* script_name)
-{
-    js_file result;
-    const t_symbol* canvas_dir = canvas_getdir(x->canvas);
-    char dirresult[MAXPDSTRING];
-    char* nameresult;
-    int fd = open_via_path(canvas_dir->s_name, script_name, "", dirresult, &nameresult, sizeof(dirresult), 1);
+    pd_error(args.Holder()->GetAlignedPointerFromInternalField(0), "%s: element %d is an array or object.", method, index);
+    return false;
+}
 
-    if (fd < 0)
-    {
-        pd_error(&x->x_obj, "Script file '%s' not found.", script_name);
-        return result;
-    }
+static void js_handle_bang(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    auto outlet = js_handle_outlet(args, 0);
 
-    sys_close(fd);
+    if (outlet != NULL)
+        outlet_bang(outlet);
+}
 
-    result.dir = string(dirresult);
-    result.path = string(dirresult);
-    result.path.append("/");
-    result.path.append(nameresult);
+static void js_handle_float(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    auto outlet = js_handle_outlet(args, 1);
+    double f;
 
-    return result;
+    if (outlet != NULL && args.Length() > 0 && args[0]->NumberValue(args.GetIsolate()->GetCurrentContext()).To(&f))
+        outlet_float(outlet, (t_float)f);
 }
 
-static t_js* js_load(t_js* x, const char* script_name, bool create_context, const v8::Local<v8::Object>* global);
+static void js_handle_symbol(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    auto outlet = js_handle_outlet(args, 1);
 
-static void js_include(const v8::FunctionCallbackInfo<v8::Value>& args)
+    if (outlet != NULL && args.Length() > 0)
+        outlet_symbol(outlet, js_value_symbol(args.GetIsolate(), args[0]));
+}
+
+// list(array) or list(a, b, ...)
+static void js_handle_list(const v8::FunctionCallbackInfo<v8::Value>& args)
 {
-    if (args.Length() < 1) return;
+    auto atoms = args.Length() != 1 ? args.Length()
+        : js_is_bulk_typed(args[0]) ? v8::Local<v8::TypedArray>::Cast(args[0])->Length()
+        : args[0]->IsArray() ? v8::Local<v8::Array>::Cast(args[0])->Length() : 1;
+    auto outlet = js_handle_outlet(args, atoms);
 
-    v8::Isolate* isolate = args.GetIsolate();
-    v8::HandleScope scope(isolate);
-    v8::Local<v8::External> f = v8::Local<v8::External>::Cast(args.Data());
-    auto x = (t_js*)f->Value();
+    if (outlet == NULL)
+        return;
 
-    if (args.Length() > 0 && args[0]->IsString())
+    auto context = args.GetIsolate()->GetCurrentContext();
+
+    if (args.Length() == 1 && js_is_bulk_typed(args[0]))
     {
-        auto script_name = js_object_to_string(isolate, args[0]);
-        v8::Local<v8::Object> global;
-        if (args.Length() > 1 && args[1]->IsObject())
-            global = v8::Local<v8::Object>::Cast(args[1]);
-        js_load(x, script_name.c_str(), false, (global.IsEmpty() ? NULL : &global));
+        auto n = v8::Local<v8::TypedArray>::Cast(args[0])->Length();
+        js_atom_buffer buf(n);
+
+        js_unmarshal_typed(args[0], buf.atoms);
+        outlet_list(outlet, &s_list, (int)n, buf.atoms);
     }
-}
+    else if (args.Length() == 1 && args[0]->IsArray())
+    {
+        auto array = v8::Local<v8::Array>::Cast(args[0]);
+        auto n = array->Length();
+        js_atom_buffer buf(n);
 
-static void js_require(const v8::FunctionCallbackInfo<v8::Value>& args)
-{
-    v8::Isolate* isolate = args.GetIsolate();
-    v8::EscapableHandleScope scope(isolate);
-    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+        for (uint32_t i = 0; i < n; i++)
+        {
+            v8::Local<v8::Value> val;
+            if (!array->Get(context, i).ToLocal(&val))
+                SETFLOAT(&buf.atoms[i], 0);
+            else if (!js_handle_atom(args, "list", &buf.atoms[i], val, (int)i))
+                return;
+        }
+
+        outlet_list(outlet, &s_list, (int)n, buf.atoms);
+    }
+    else
+    {
+        js_atom_buffer buf(args.Length());
+
+        for (int i = 0; i < args.Length(); i++)
+        {
+            if (!js_handle_atom(args, "list", &buf.atoms[i], args[i], i))
+                return;
+        }
+
+        outlet_list(outlet, &s_list, args.Length(), buf.atoms);
+    }
+}
+
+// anything(selector, a, b, ...)
+static void js_handle_anything(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    if (args.Length() < 1)
+        return;
+
+    auto outlet = js_handle_outlet(args, args.Length());
+
+    if (outlet == NULL)
+        return;
+
+    js_atom_buffer buf(args.Length() - 1);
+
+    for (int i = 1; i < args.Length(); i++)
+    {
+        if (!js_handle_atom(args, "anything", &buf.atoms[i - 1], args[i], i - 1))
+            return;
+    }
+
+    outlet_anything(outlet, js_value_symbol(args.GetIsolate(), args[0]), args.Length() - 1, buf.atoms);
+}
+
+static v8::Local<v8::ObjectTemplate> js_outlet_handle_template(v8::Isolate* isolate)
+{
+    static v8::Eternal<v8::ObjectTemplate> templ;
+
+    if (templ.IsEmpty())
+    {
+        auto f = v8::FunctionTemplate::New(isolate);
+        auto signature = v8::Signature::New(isolate, f);
+        auto proto = f->PrototypeTemplate();
+
+        f->SetClassName(v8::String::NewFromUtf8Literal(isolate, "Outlet"));
+        f->InstanceTemplate()->SetInternalFieldCount(2);
+        proto->Set(isolate, "bang", v8::FunctionTemplate::New(isolate, js_handle_bang, v8::Local<v8::Value>(), signature));
+        proto->Set(isolate, "float", v8::FunctionTemplate::New(isolate, js_handle_float, v8::Local<v8::Value>(), signature));
+        proto->Set(isolate, "symbol", v8::FunctionTemplate::New(isolate, js_handle_symbol, v8::Local<v8::Value>(), signature));
+        proto->Set(isolate, "list", v8::FunctionTemplate::New(isolate, js_handle_list, v8::Local<v8::Value>(), signature));
+        proto->Set(isolate, "anything", v8::FunctionTemplate::New(isolate, js_handle_anything, v8::Local<v8::Value>(), signature));
+        templ.Set(isolate, f->InstanceTemplate());
+    }
+
+    return templ.Get(isolate);
+}
+
+// Keeps outlet[n] in sync with the outlets of x. The handles call outlet_float,
+// outlet_list etc. directly instead of sniffing the arguments like outlet(n, ...).
+static void js_update_outlet_handles(t_js* x)
+{
+    if (x->context == nullptr)
+        return;
+
+    v8::HandleScope handle_scope(js_isolate);
+    auto context = x->context->Get(js_isolate);
+    v8::Context::Scope context_scope(context);
+    v8::Local<v8::Value> outletVal;
+
+    if (!context->Global()->Get(context, v8::String::NewFromUtf8Literal(js_isolate, "outlet")).ToLocal(&outletVal)
+        || !outletVal->IsObject())
+        return;
+
+    auto outlet = v8::Local<v8::Object>::Cast(outletVal);
+    auto n = (uint32_t)x->outlets.size();
+
+    for (auto i = x->outlet_handles; i < n; i++)
+    {
+        v8::Local<v8::Object> handle;
+
+        if (!js_outlet_handle_template(js_isolate)->NewInstance(context).ToLocal(&handle))
+            return;
+
+        handle->SetAlignedPointerInInternalField(0, x);
+        handle->SetAlignedPointerInInternalField(1, js_handle_index(i));
+        outlet->Set(context, i, handle).FromMaybe(false);
+    }
+
+    for (auto i = n; i < x->outlet_handles; i++)
+        outlet->Delete(context, i).FromMaybe(false);
+
+    x->outlet_handles = n;
+}
+
+static void js_messnamed(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    if (args.Length() < 1) return;
+
+    v8::Isolate* isolate = args.GetIsolate();
+    v8::HandleScope scope(isolate);
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+    v8::Local<v8::String> symbolString;
+    v8::Local<v8::External> f = v8::Local<v8::External>::Cast(args.Data());
+    auto x = (t_js*)f->Value();
+
+    if (args[0]->ToString(context).ToLocal(&symbolString))
+    {
+        t_symbol *sym = js_string_symbol(isolate, symbolString);
+
+        if (sym->s_thing != NULL)
+        {
+            vector<t_atom> argv;
+
+            for (int i = 1; i < args.Length(); i++)
+                js_unmarshal_arg(args[i], isolate, context, x, argv);
+
+            if (!argv.empty())
+            {
+                auto type = js_get_type(argv);
+
+                if (type != NULL)
+                {
+                    if (type == argv[0].a_w.w_symbol)
+                        argv.erase(argv.begin());
+
+                    pd_typedmess(sym->s_thing, type, (int)argv.size(), argv.data());
+                }
+            }
+        }
+    }
+}
+
+static void js_throw_error(v8::Isolate* isolate, const string& msg)
+{
+    isolate->ThrowException(v8::Exception::Error(js_new_string(isolate, msg).ToLocalChecked()));
+}
+
+// Arrays written from JS are redrawn from a clock, at most once per redrawinterval ms
+// (0 redraws once per scheduler tick). They are kept by name and looked up again when
+// the clock fires, in case an array was deleted in the meantime.
+static vector<t_symbol*> js_pdarray_dirty;
+static t_clock* js_pdarray_clock = NULL;
+static double js_pdarray_interval = 0;
+static double js_pdarray_lastredraw = 0;
+static bool js_pdarray_scheduled = false;
+
+static void js_pdarray_tick(void* dummy)
+{
+    js_pdarray_scheduled = false;
+    js_pdarray_lastredraw = clock_getlogicaltime();
+
+    for (auto name : js_pdarray_dirty)
+    {
+        auto a = (t_garray*)pd_findbyclass(name, garray_class);
+
+        if (a != NULL)
+            garray_redraw(a);
+    }
+
+    js_pdarray_dirty.clear();
+}
+
+static void js_pdarray_setdirty(t_symbol* name)
+{
+    if (std::find(js_pdarray_dirty.begin(), js_pdarray_dirty.end(), name) == js_pdarray_dirty.end())
+        js_pdarray_dirty.push_back(name);
+
+    if (!js_pdarray_scheduled)
+    {
+        js_pdarray_scheduled = true;
+        clock_delay(js_pdarray_clock, std::max(0.0, js_pdarray_interval - clock_gettimesince(js_pdarray_lastredraw)));
+    }
+}
+
+// new PdArray(name) binds the Pd array name. The array is looked up on every call,
+// so the object stays usable when the array is deleted and created again.
+static void js_pdarray_new(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    auto isolate = args.GetIsolate();
+
+    if (!args.IsConstructCall())
+    {
+        js_throw_error(isolate, "PdArray must be called with new.");
+        return;
+    }
+
+    if (args.Length() < 1)
+    {
+        js_throw_error(isolate, "PdArray needs the name of an array.");
+        return;
+    }
+
+    auto name = js_value_symbol(isolate, args[0]);
+
+    args.This()->SetAlignedPointerInInternalField(0, name);
+    args.This()->Set(isolate->GetCurrentContext(), v8::String::NewFromUtf8Literal(isolate, "name"),
+        js_symbol_string(isolate, name)).FromMaybe(false);
+}
+
+// The bound array and its contents, throws if there is no such array.
+static t_garray* js_pdarray_words(const v8::FunctionCallbackInfo<v8::Value>& args, int* n, t_word** vec)
+{
+    auto name = (t_symbol*)args.Holder()->GetAlignedPointerFromInternalField(0);
+    auto a = (t_garray*)pd_findbyclass(name, garray_class);
+
+    if (a == NULL)
+    {
+        js_throw_error(args.GetIsolate(), string("Array '") + name->s_name + "' not found.");
+        return NULL;
+    }
+
+    if (!garray_getfloatwords(a, n, vec))
+    {
+        js_throw_error(args.GetIsolate(), string("Array '") + name->s_name + "' is not a float array.");
+        return NULL;
+    }
+
+    return a;
+}
+
+// Clamps the range [index, index + count) to an array of n elements.
+static int js_pdarray_range(int n, double index, double count, int* start)
+{
+    auto first = std::max(0.0, std::min(index, (double)n));
+    *start = (int)first;
+    return (int)std::max(0.0, std::min(count, n - first));
+}
+
+template <typename T>
+static void js_pdarray_read(const t_word* vec, v8::Local<v8::TypedArray> target, int count)
+{
+    auto data = js_typed_data<T>(target);
+
+    for (int i = 0; i < count; i++)
+        data[i] = (T)vec[i].w_float;
+}
+
+template <typename T>
+static void js_pdarray_write(t_word* vec, v8::Local<v8::TypedArray> source, int count)
+{
+    auto data = js_typed_data<const T>(source);
+
+    for (int i = 0; i < count; i++)
+        vec[i].w_float = (t_float)data[i];
+}
+
+static void js_pdarray_length(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    int n;
+    t_word* vec;
+
+    if (js_pdarray_words(args, &n, &vec) != NULL)
+        args.GetReturnValue().Set(n);
+}
+
+// peek(index, count) returns a new Float32Array, peek(index, target) fills a
+// Float32Array or Float64Array. Ranges past the end of the array are cut off.
+static void js_pdarray_peek(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    auto isolate = args.GetIsolate();
+    auto context = isolate->GetCurrentContext();
+    int n, start;
+    t_word* vec;
+    double index;
+    double length = 0;
+
+    if (args.Length() < 2 || !args[0]->NumberValue(context).To(&index))
+    {
+        js_throw_error(isolate, "peek needs an index and a count or a Float32Array/Float64Array.");
+        return;
+    }
+
+    auto typed = args[1]->IsFloat32Array() || args[1]->IsFloat64Array();
+
+    // valueOf can run code that resizes or frees the array, convert before looking it up
+    if (!typed && !args[1]->NumberValue(context).To(&length))
+        return;
+
+    if (js_pdarray_words(args, &n, &vec) == NULL)
+        return;
+
+    if (typed)
+    {
+        auto target = v8::Local<v8::TypedArray>::Cast(args[1]);
+        auto count = js_pdarray_range(n, index, (double)target->Length(), &start);
+
+        if (target->IsFloat32Array())
+            js_pdarray_read<float>(vec + start, target, count);
+        else
+            js_pdarray_read<double>(vec + start, target, count);
+
+        args.GetReturnValue().Set(target);
+    }
+    else
+    {
+        auto count = js_pdarray_range(n, index, length, &start);
+        auto target = v8::Float32Array::New(v8::ArrayBuffer::New(isolate, count * sizeof(float)), 0, count);
+
+        js_pdarray_read<float>(vec + start, target, count);
+        args.GetReturnValue().Set(target);
+    }
+}
+
+// poke(index, values[, redraw]) writes a Float32Array, Float64Array, Int32Array, an
+// array of numbers or a single number. Values past the end of the array are dropped.
+// The array is redrawn from the redraw clock unless redraw is false.
+static void js_pdarray_poke(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    auto isolate = args.GetIsolate();
+    auto context = isolate->GetCurrentContext();
+    int n, start;
+    t_word* vec;
+    double index;
+    vector<t_float> converted;
+
+    if (args.Length() < 2 || !args[0]->NumberValue(context).To(&index))
+    {
+        js_throw_error(isolate, "poke needs an index and values.");
+        return;
+    }
+
+    auto values = args[1];
+
+    // valueOf can run code that resizes or frees the array, so everything that isn't
+    // a typed array is converted before the words are looked up
+    if (values->IsArray())
+    {
+        auto array = v8::Local<v8::Array>::Cast(values);
+        converted.resize(array->Length());
+
+        for (uint32_t i = 0; i < converted.size(); i++)
+        {
+            v8::Local<v8::Value> val;
+            double f;
+
+            if (!array->Get(context, i).ToLocal(&val) || !val->NumberValue(context).To(&f))
+                return;
+
+            converted[i] = (t_float)f;
+        }
+    }
+    else if (!js_is_bulk_typed(values))
+    {
+        double f;
+
+        if (!values->NumberValue(context).To(&f))
+            return;
+
+        converted.push_back((t_float)f);
+    }
+
+    if (js_pdarray_words(args, &n, &vec) == NULL)
+        return;
+
+    if (js_is_bulk_typed(values))
+    {
+        auto source = v8::Local<v8::TypedArray>::Cast(values);
+        auto count = js_pdarray_range(n, index, (double)source->Length(), &start);
+
+        if (source->IsFloat32Array())
+            js_pdarray_write<float>(vec + start, source, count);
+        else if (source->IsFloat64Array())
+            js_pdarray_write<double>(vec + start, source, count);
+        else
+            js_pdarray_write<int32_t>(vec + start, source, count);
+    }
+    else
+    {
+        auto count = js_pdarray_range(n, index, (double)converted.size(), &start);
+
+        for (int i = 0; i < count; i++)
+            vec[start + i].w_float = converted[i];
+    }
+
+    if (args.Length() < 3 || args[2]->BooleanValue(isolate))
+        js_pdarray_setdirty((t_symbol*)args.Holder()->GetAlignedPointerFromInternalField(0));
+}
+
+// redraw() schedules a redraw, e.g. after writes with poke(index, values, false).
+static void js_pdarray_redraw(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    int n;
+    t_word* vec;
+
+    if (js_pdarray_words(args, &n, &vec) != NULL)
+        js_pdarray_setdirty((t_symbol*)args.Holder()->GetAlignedPointerFromInternalField(0));
+}
+
+static void js_pdarray_resize(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    int n;
+    t_word* vec;
+    double size;
+
+    auto a = js_pdarray_words(args, &n, &vec);
+
+    if (a == NULL)
+        return;
+
+    if (args.Length() < 1 || !args[0]->NumberValue(args.GetIsolate()->GetCurrentContext()).To(&size) || size < 1)
+    {
+        js_throw_error(args.GetIsolate(), "resize needs a size of at least 1.");
+        return;
+    }
+
+    garray_resize_long(a, (long)size);
+}
+
+static v8::Local<v8::FunctionTemplate> js_pdarray_template(v8::Isolate* isolate)
+{
+    auto f = v8::FunctionTemplate::New(isolate, js_pdarray_new);
+    auto signature = v8::Signature::New(isolate, f);
+    auto proto = f->PrototypeTemplate();
+
+    f->SetClassName(v8::String::NewFromUtf8Literal(isolate, "PdArray"));
+    f->InstanceTemplate()->SetInternalFieldCount(1);
+    proto->Set(isolate, "length", v8::FunctionTemplate::New(isolate, js_pdarray_length, v8::Local<v8::Value>(), signature));
+    proto->Set(isolate, "peek", v8::FunctionTemplate::New(isolate, js_pdarray_peek, v8::Local<v8::Value>(), signature));
+    proto->Set(isolate, "poke", v8::FunctionTemplate::New(isolate, js_pdarray_poke, v8::Local<v8::Value>(), signature));
+    proto->Set(isolate, "resize", v8::FunctionTemplate::New(isolate, js_pdarray_resize, v8::Local<v8::Value>(), signature));
+    proto->Set(isolate, "redraw", v8::FunctionTemplate::New(isolate, js_pdarray_redraw, v8::Local<v8::Value>(), signature));
+
+    return f;
+}
+
+// Promise reactions run at explicit checkpoints: after every message, timer callback
+// and script load, and between DSP ticks, so async functions continue in a predictable
+// order. js_watch_depth counts the calls into JS on the stack; a checkpoint only runs
+// once the outermost one has returned, never nested in a call that outlets into
+// another js object.
+static void js_run_microtasks()
+{
+    if (js_watch_depth > 0)
+        return;
+
+    js_watch_begin();
+    js_isolate->PerformMicrotaskCheckpoint();
+
+    if (js_isolate->IsExecutionTerminating())
+        pd_error(NULL, "js: promise reactions terminated after %g ms.", js_watch_limit);
+
+    js_watch_end();
+}
+
+// The duration of a DSP tick in ms, the default period of pdjs' clocks.
+static double js_tick_ms()
+{
+    auto sr = sys_getsr();
+    return sr > 0 ? 1000.0 * sys_getblksize() / sr : 1.0;
+}
+
+// All timers share one Pd clock and a hierarchical timer wheel, so that scheduling
+// thousands of them doesn't walk Pd's sorted clock list. Level 0 has a slot per
+// ms for the next 256 ms, each further level covers 256 times the range of the one
+// below and is cascaded down when level 0 wraps around. Timers of the current ms
+// move to a small heap and are called in the order of their exact logical time.
+static const int js_timer_bits = 8;
+static const int js_timer_slots = 1 << js_timer_bits;
+static const int js_timer_levels = 4;
+static t_js_timer* js_timer_wheel[js_timer_levels][js_timer_slots] = {};
+static vector<t_js_timer*> js_timer_ready;
+static int64_t js_timer_jiffies = 0; // the next ms of level 0 to move to js_timer_ready
+static size_t js_timer_count = 0; // timers in the wheel and js_timer_ready
+static uint64_t js_timer_seq = 0;
+static t_clock* js_timer_clock = NULL;
+static double js_timer_unit = 1; // logical time units per ms
+static double js_timer_wake = HUGE_VAL;
+
+static void js_timer_tick(t_js_timer* t);
+
+static void js_count_time(t_js* x, std::chrono::steady_clock::time_point start)
+{
+    auto us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    x->stats.total_us += us;
+    x->stats.max_us = std::max(x->stats.max_us, us);
+}
+
+static int64_t js_timer_jiffy(double time)
+{
+    // the tolerance keeps a wake-up at the start of a ms in that ms
+    return (int64_t)std::floor(time / js_timer_unit + 1e-6);
+}
+
+// Delays and intervals are clamped so that due times stay finite: NaN and non-positive
+// delays fire right away, intervals run at least every 0.01 ms like [metro] and without
+// one every DSP tick, and nothing waits longer than about 24 days.
+static const double js_timer_max_ms = 2147483647;
+static const double js_timer_min_interval_ms = 0.01;
+
+static double js_timer_delay(double ms)
+{
+    return ms > 0 ? std::min(ms, js_timer_max_ms) : 0;
+}
+
+static double js_timer_interval(double ms)
+{
+    return ms > 0 ? std::min(std::max(ms, js_timer_min_interval_ms), js_timer_max_ms) : js_tick_ms();
+}
+
+static bool js_timer_later(const t_js_timer* a, const t_js_timer* b)
+{
+    return a->due > b->due || (a->due == b->due && a->seq > b->seq);
+}
+
+static void js_timer_place(t_js_timer* t)
+{
+    auto expires = js_timer_jiffy(t->due);
+
+    if (expires < js_timer_jiffies)
+    {
+        t->slot = nullptr;
+        t->ready = true;
+        js_timer_ready.push_back(t);
+        std::push_heap(js_timer_ready.begin(), js_timer_ready.end(), js_timer_later);
+        return;
+    }
+
+    auto delta = expires - js_timer_jiffies;
+    auto level = 0;
+
+    while (level < js_timer_levels - 1 && delta >= (int64_t)1 << (js_timer_bits * (level + 1)))
+        level++;
+
+    // beyond the wheel, cascaded again until it is in range
+    if (delta >= (int64_t)1 << (js_timer_bits * js_timer_levels))
+        expires = js_timer_jiffies + ((int64_t)1 << (js_timer_bits * js_timer_levels)) - 1;
+
+    auto slot = &js_timer_wheel[level][(expires >> (js_timer_bits * level)) & (js_timer_slots - 1)];
+
+    t->slot = slot;
+    t->prev = nullptr;
+    t->next = *slot;
+    if (*slot != nullptr)
+        (*slot)->prev = t;
+    *slot = t;
+}
+
+static void js_timer_set(double time)
+{
+    js_timer_wake = time;
+    clock_set(js_timer_clock, time);
+}
+
+static void js_timer_add(t_js_timer* t)
+{
+    // nothing to cascade, start the wheel at the current time
+    if (js_timer_count == 0)
+        js_timer_jiffies = js_timer_jiffy(clock_getlogicaltime());
+
+    t->seq = js_timer_seq++;
+    js_timer_count++;
+    js_timer_place(t);
+
+    if (t->due < js_timer_wake)
+        js_timer_set(t->due);
+}
+
+static void js_timer_remove(t_js_timer* t)
+{
+    if (t->ready)
+    {
+        t->cancelled = true;
+        return;
+    }
+
+    if (t->slot != nullptr)
+    {
+        if (t->prev != nullptr)
+            t->prev->next = t->next;
+        else
+            *t->slot = t->next;
+        if (t->next != nullptr)
+            t->next->prev = t->prev;
+
+        js_timer_count--;
+    }
+
+    delete t;
+}
+
+// Moves the timers of the next ms to js_timer_ready, cascading the higher levels first
+// when level 0 wraps around.
+static void js_timer_step()
+{
+    auto index = js_timer_jiffies & (js_timer_slots - 1);
+
+    for (auto level = 1; index == 0 && level < js_timer_levels; level++)
+    {
+        auto i = (js_timer_jiffies >> (js_timer_bits * level)) & (js_timer_slots - 1);
+        auto t = js_timer_wheel[level][i];
+
+        js_timer_wheel[level][i] = nullptr;
+
+        while (t != nullptr)
+        {
+            auto next = t->next;
+            js_timer_place(t);
+            t = next;
+        }
+
+        if (i != 0)
+            break;
+    }
+
+    auto t = js_timer_wheel[0][index];
+
+    js_timer_wheel[0][index] = nullptr;
+    js_timer_jiffies++;
+
+    while (t != nullptr)
+    {
+        auto next = t->next;
+        js_timer_place(t);
+        t = next;
+    }
+}
+
+// Wakes up for the next timer of the current ms, the next busy ms before level 0
+// wraps around, or the wrap-around to cascade.
+static void js_timer_schedule()
+{
+    if (!js_timer_ready.empty())
+    {
+        js_timer_set(js_timer_ready.front()->due);
+    }
+    else if (js_timer_count > 0)
+    {
+        auto index = js_timer_jiffies & (js_timer_slots - 1);
+        // at index 0 the higher levels are cascaded first, which may fill the slot
+        auto next = js_timer_jiffies;
+
+        if (index != 0)
+        {
+            next += js_timer_slots - index;
+
+            for (auto i = index; i < js_timer_slots; i++)
+            {
+                if (js_timer_wheel[0][i] != nullptr)
+                {
+                    next = js_timer_jiffies + (i - index);
+                    break;
+                }
+            }
+        }
+
+        js_timer_set(std::max((double)next * js_timer_unit, clock_getlogicaltime()));
+    }
+    else
+    {
+        js_timer_wake = HUGE_VAL;
+        clock_unset(js_timer_clock);
+    }
+}
+
+static void js_timer_run(void* dummy)
+{
+    auto now = clock_getlogicaltime();
+    auto jiffy = js_timer_jiffy(now);
+
+    js_timer_wake = HUGE_VAL;
+
+    while (true)
+    {
+        while (js_timer_jiffies <= jiffy)
+            js_timer_step();
+
+        if (js_timer_ready.empty() || js_timer_ready.front()->due > now)
+            break;
+
+        std::pop_heap(js_timer_ready.begin(), js_timer_ready.end(), js_timer_later);
+        auto t = js_timer_ready.back();
+        js_timer_ready.pop_back();
+        js_timer_count--;
+        t->ready = false;
+
+        if (t->cancelled)
+            delete t;
+        else
+            js_timer_tick(t);
+    }
+
+    js_timer_schedule();
+}
+
+static t_js_timer* js_timer_start(t_js* x, double delay, double interval, int remaining)
+{
+    auto t = new t_js_timer();
+
+    t->owner = x;
+
+    // after a wrap around, skip ids still held by pending timers and 0, which
+    // handles never use
+    do
+        t->id = ++x->timer_id;
+    while (t->id == 0 || x->timers.count(t->id) > 0);
+
+    t->due = clock_getsystimeafter(js_timer_delay(delay));
+    t->interval = js_timer_interval(interval);
+    t->remaining = remaining;
+    x->timers[t->id] = t;
+    js_timer_add(t);
+
+    return t;
+}
+
+static void js_timer_free(t_js_timer* t)
+{
+    // release the callback now, the timer itself may still wait in js_timer_ready
+    t->func.Reset();
+    t->args.clear();
+    t->task.Reset();
+    js_timer_remove(t);
+}
+
+static void js_clear_timer(t_js* x, uint32_t id)
+{
+    auto it = x->timers.find(id);
+
+    if (it != x->timers.end())
+    {
+        auto t = it->second;
+        x->timers.erase(it);
+        js_timer_free(t);
+    }
+}
+
+static void js_clear_timers(t_js* x)
+{
+    for (auto& entry : x->timers)
+        js_timer_free(entry.second);
+
+    x->timers.clear();
+}
+
+static double js_task_interval_ms(v8::Local<v8::Context> context, v8::Local<v8::Object> task)
+{
+    v8::Local<v8::Value> val;
+    double interval;
+
+    // a repeating clock without delay would fire forever within the same logical time
+    if (task->Get(context, v8::String::NewFromUtf8Literal(js_isolate, "interval")).ToLocal(&val)
+        && val->NumberValue(context).To(&interval))
+        return js_timer_interval(interval);
+
+    return js_tick_ms();
+}
+
+// Runs task.function with task.object as this and task.arguments, counting task.iterations.
+static bool js_task_call(v8::Local<v8::Context> context, v8::Local<v8::Object> task)
+{
+    v8::Local<v8::Value> func, recv, arguments, iterations;
+    vector<v8::Local<v8::Value>> argv;
+    int32_t count = 0;
+
+    if (!task->Get(context, v8::String::NewFromUtf8Literal(js_isolate, "function")).ToLocal(&func)
+        || !func->IsFunction()
+        || !task->Get(context, v8::String::NewFromUtf8Literal(js_isolate, "object")).ToLocal(&recv)
+        || !task->Get(context, v8::String::NewFromUtf8Literal(js_isolate, "arguments")).ToLocal(&arguments))
+        return false;
+
+    if (arguments->IsArray())
+    {
+        auto array = v8::Local<v8::Array>::Cast(arguments);
+
+        for (uint32_t i = 0; i < array->Length(); i++)
+        {
+            v8::Local<v8::Value> arg;
+            if (array->Get(context, i).ToLocal(&arg))
+                argv.push_back(arg);
+        }
+    }
+
+    if (task->Get(context, v8::String::NewFromUtf8Literal(js_isolate, "iterations")).ToLocal(&iterations))
+        count = iterations->Int32Value(context).FromMaybe(0);
+
+    if (task->Set(context, v8::String::NewFromUtf8Literal(js_isolate, "iterations"), v8::Integer::New(js_isolate, count + 1)).IsNothing())
+        return false;
+
+    if (recv->IsNullOrUndefined())
+        recv = context->Global();
+
+    v8::Local<v8::Value> result;
+
+    return v8::Local<v8::Function>::Cast(func)->Call(context, recv, (int)argv.size(), argv.data()).ToLocal(&result);
+}
+
+static void js_timer_tick(t_js_timer* t)
+{
+    auto x = t->owner;
+    v8::HandleScope handle_scope(js_isolate);
+    auto context = x->context->Get(js_isolate);
+    v8::Context::Scope context_scope(context);
+    v8::TryCatch trycatch(js_isolate);
+    v8::Local<v8::Object> task = t->task.Get(js_isolate);
+    v8::Local<v8::Function> func = t->func.Get(js_isolate);
+    vector<v8::Local<v8::Value>> argv;
+
+    for (auto& arg : t->args)
+        argv.push_back(arg.Get(js_isolate));
+
+    if (t->remaining > 0)
+        t->remaining--;
+
+    // reschedule or free before the call, the callback may clear the timer itself
+    if (t->remaining != 0)
+    {
+        if (!task.IsEmpty())
+            t->interval = js_task_interval_ms(context, task);
+        t->due += t->interval * js_timer_unit;
+        js_timer_add(t);
+    }
+    else
+    {
+        js_clear_timer(x, t->id);
+    }
+
+    v8::Local<v8::Value> result;
+    js_watch_begin();
+    auto start = std::chrono::steady_clock::now();
+    auto ok = !task.IsEmpty() ? js_task_call(context, task)
+        : func->Call(context, context->Global(), (int)argv.size(), argv.data()).ToLocal(&result);
+    js_count_time(x, start);
+
+    if (!ok && trycatch.HasCaught())
+        pd_error(&x->x_obj, "Error calling timer:\n%s", js_get_exception_msg(js_isolate, &trycatch).c_str());
+
+    js_watch_end();
+
+    js_run_microtasks();
+}
+
+// setTimeout(func, delay, ...args) and setInterval(func, interval, ...args), timed in
+// Pd's logical time. They return an id for clearTimeout/clearInterval.
+static void js_set_timer(const v8::FunctionCallbackInfo<v8::Value>& args, bool repeat)
+{
+    auto isolate = args.GetIsolate();
+    auto context = isolate->GetCurrentContext();
+    auto x = (t_js*)v8::Local<v8::External>::Cast(args.Data())->Value();
+    double delay = 0;
+
+    if (args.Length() < 1 || !args[0]->IsFunction())
+    {
+        js_throw_error(isolate, repeat ? "setInterval needs a function." : "setTimeout needs a function.");
+        return;
+    }
+
+    if (args.Length() > 1 && !args[1]->NumberValue(context).To(&delay))
+        return;
+
+    if (repeat)
+        delay = js_timer_interval(delay);
+
+    auto t = js_timer_start(x, delay, delay, repeat ? -1 : 1);
+
+    t->func.Reset(isolate, v8::Local<v8::Function>::Cast(args[0]));
+
+    for (int i = 2; i < args.Length(); i++)
+        t->args.emplace_back(isolate, args[i]);
+
+    args.GetReturnValue().Set(t->id);
+}
+
+static void js_set_timeout(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    js_set_timer(args, false);
+}
+
+static void js_set_interval(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    js_set_timer(args, true);
+}
+
+static void js_clear_timeout(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    auto x = (t_js*)v8::Local<v8::External>::Cast(args.Data())->Value();
+    uint32_t id;
+
+    if (args.Length() > 0 && args[0]->IsNumber() && args[0]->Uint32Value(args.GetIsolate()->GetCurrentContext()).To(&id))
+        js_clear_timer(x, id);
+}
+
+// Task as in Max: new Task(function, object, ...arguments). The timer id of a scheduled
+// task is kept in internal field 0, the owning instance in field 1.
+static t_js* js_task_owner(v8::Local<v8::Object> task)
+{
+    return (t_js*)task->GetAlignedPointerFromInternalField(1);
+}
+
+static uint32_t js_task_timer(v8::Local<v8::Object> task)
+{
+    return (uint32_t)(reinterpret_cast<uintptr_t>(task->GetAlignedPointerFromInternalField(0)) >> 1);
+}
+
+static void js_task_cancel(v8::Local<v8::Object> task)
+{
+    js_clear_timer(js_task_owner(task), js_task_timer(task));
+    task->SetAlignedPointerInInternalField(0, nullptr);
+}
+
+static void js_task_new(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    auto isolate = args.GetIsolate();
+    auto context = isolate->GetCurrentContext();
+    auto task = args.This();
+    vector<v8::Local<v8::Value>> arguments;
+
+    if (!args.IsConstructCall())
+    {
+        js_throw_error(isolate, "Task must be called with new.");
+        return;
+    }
+
+    for (int i = 2; i < args.Length(); i++)
+        arguments.push_back(args[i]);
+
+    task->SetAlignedPointerInInternalField(0, nullptr);
+    task->SetAlignedPointerInInternalField(1, v8::Local<v8::External>::Cast(args.Data())->Value());
+
+    if (task->Set(context, v8::String::NewFromUtf8Literal(isolate, "function"), args[0]).IsNothing()
+        || task->Set(context, v8::String::NewFromUtf8Literal(isolate, "object"), args[1]).IsNothing()
+        || task->Set(context, v8::String::NewFromUtf8Literal(isolate, "arguments"), v8::Array::New(isolate, arguments.data(), arguments.size())).IsNothing()
+        || task->Set(context, v8::String::NewFromUtf8Literal(isolate, "interval"), v8::Number::New(isolate, 500)).IsNothing()
+        || task->Set(context, v8::String::NewFromUtf8Literal(isolate, "iterations"), v8::Integer::New(isolate, 0)).IsNothing())
+        return;
+}
+
+static void js_task_start(const v8::FunctionCallbackInfo<v8::Value>& args, double delay, int count)
+{
+    auto context = args.GetIsolate()->GetCurrentContext();
+    auto task = args.Holder();
+    auto x = js_task_owner(task);
+
+    js_task_cancel(task);
+
+    auto t = js_timer_start(x, delay, js_task_interval_ms(context, task), count);
+
+    t->task.Reset(js_isolate, task);
+    task->SetAlignedPointerInInternalField(0, reinterpret_cast<void*>((uintptr_t)t->id << 1));
+}
+
+// repeat(count = infinite, initialdelay = 0) calls the task count times, every interval ms.
+static void js_task_repeat(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    auto context = args.GetIsolate()->GetCurrentContext();
+    int32_t count = -1;
+    double delay = 0;
+
+    if (args.Length() > 0 && (!args[0]->Int32Value(context).To(&count) || count <= 0))
+        count = -1;
+
+    if (args.Length() > 1 && !args[1]->NumberValue(context).To(&delay))
+        delay = 0;
+
+    if (args.Holder()->Set(context, v8::String::NewFromUtf8Literal(js_isolate, "iterations"), v8::Integer::New(js_isolate, 0)).IsNothing())
+        return;
+
+    js_task_start(args, delay, count);
+}
+
+// schedule(delay = 0) calls the task once.
+static void js_task_schedule(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    double delay = 0;
+
+    if (args.Length() > 0 && !args[0]->NumberValue(args.GetIsolate()->GetCurrentContext()).To(&delay))
+        delay = 0;
+
+    js_task_start(args, delay, 1);
+}
+
+static void js_task_execute(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    js_task_call(args.GetIsolate()->GetCurrentContext(), args.Holder());
+}
+
+static void js_task_cancel(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    js_task_cancel(args.Holder());
+}
+
+static void js_task_running_getter(v8::Local<v8::Name> property,
+    const v8::PropertyCallbackInfo<v8::Value>& info)
+{
+    auto x = js_task_owner(info.Holder());
+
+    info.GetReturnValue().Set(x->timers.count(js_task_timer(info.Holder())) > 0);
+}
+
+static v8::Local<v8::FunctionTemplate> js_task_template(v8::Isolate* isolate, v8::Local<v8::External> data)
+{
+    auto f = v8::FunctionTemplate::New(isolate, js_task_new, data);
+    auto signature = v8::Signature::New(isolate, f);
+    auto proto = f->PrototypeTemplate();
+
+    f->SetClassName(v8::String::NewFromUtf8Literal(isolate, "Task"));
+    f->InstanceTemplate()->SetInternalFieldCount(2);
+    f->InstanceTemplate()->SetAccessor(v8::String::NewFromUtf8Literal(isolate, "running"), js_task_running_getter);
+    proto->Set(isolate, "repeat", v8::FunctionTemplate::New(isolate, js_task_repeat, v8::Local<v8::Value>(), signature));
+    proto->Set(isolate, "schedule", v8::FunctionTemplate::New(isolate, js_task_schedule, v8::Local<v8::Value>(), signature));
+    proto->Set(isolate, "execute", v8::FunctionTemplate::New(isolate, js_task_execute, v8::Local<v8::Value>(), signature));
+    proto->Set(isolate, "cancel", v8::FunctionTemplate::New(isolate, js_task_cancel, v8::Local<v8::Value>(), signature));
+    proto->Set(isolate, "freepeer", v8::FunctionTemplate::New(isolate, js_task_cancel, v8::Local<v8::Value>(), signature));
+
+    return f;
+}
+
+struct js_file
+{
+    string path;
+    string dir;
+};
+
+static bool js_openpath(const char* dir, const char* name, js_file* result)
+{
+    char dirresult[MAXPDSTRING];
+    char* nameresult;
+    int fd = open_via_path(dir, name, "", dirresult, &nameresult, sizeof(dirresult), 1);
+
+    if (fd < 0)
+        return false;
+
+    sys_close(fd);
+
+    result->dir = string(dirresult);
+    result->path = string(dirresult);
+    result->path.append("/");
+    result->path.append(nameresult);
+
+    return true;
+}
+
+static js_file js_getfile(const t_js *x, const char* script_name)
+{
+    js_file result;
+    const t_symbol* canvas_dir = canvas_getdir(x->canvas);
+
+    if (!js_openpath(canvas_dir->s_name, script_name, &result))
+    {
+        pd_error(&x->x_obj, "Script file '%s' not found.", script_name);
+    }
+
+    return result;
+}
+
+static t_js* js_load(t_js* x, const char* script_name, bool create_context, const v8::Local<v8::Object>* global);
+static v8::Local<v8::Context> js_get_module_context();
+
+// Compiles a script file once per process. Instances loading the same file only bind
+// the shared script to their own context; the entry is replaced when the contents change.
+// On a miss the on-disk code cache is consumed if there is a valid one, otherwise
+// produce_cache is set so the caller writes one after the script has run.
+static v8::MaybeLocal<v8::UnboundScript> js_compile_script(const string& path, const string& contents, size_t hash,
+    v8::ScriptOrigin& origin, bool* produce_cache)
+{
+    auto it = js_scripts.find(path);
+
+    *produce_cache = false;
+
+    if (it != js_scripts.end() && it->second.hash == hash)
+        return it->second.script.Get(js_isolate);
+
+    v8::Local<v8::String> source;
+    v8::Local<v8::UnboundScript> script;
+
+    if (!js_new_string(js_isolate, contents).ToLocal(&source))
+        return v8::MaybeLocal<v8::UnboundScript>();
+
+    auto cache = js_read_code_cache(path, JS_CACHE_SCRIPT, hash);
+    auto options = cache != nullptr ? v8::ScriptCompiler::kConsumeCodeCache : v8::ScriptCompiler::kNoCompileOptions;
+    v8::ScriptCompiler::Source src(source, origin, cache);
+
+    if (!v8::ScriptCompiler::CompileUnboundScript(js_isolate, &src, options).ToLocal(&script))
+        return v8::MaybeLocal<v8::UnboundScript>();
+
+    *produce_cache = cache == nullptr || src.GetCachedData()->rejected;
+
+    auto& entry = js_scripts[path];
+    entry.hash = hash;
+    entry.script.Reset(js_isolate, script);
+
+    return script;
+}
+
+// Compiles a file as the body of a function with the given parameters and context
+// extensions, using the code cache, and calls it. Errors are reported on x, which may be null.
+static bool js_call_file(t_js* x, v8::Local<v8::Context> context, const string& path, const string& contents, js_cache_kind kind,
+    size_t param_count, v8::Local<v8::String> params[], size_t extension_count, v8::Local<v8::Object> extensions[],
+    v8::Local<v8::Value> recv, int argc, v8::Local<v8::Value> argv[])
+{
+    v8::TryCatch trycatch(js_isolate);
+    v8::Local<v8::String> file_name;
+    v8::Local<v8::String> source;
+    v8::Local<v8::Function> function;
+
+    if (!js_new_string(js_isolate, path).ToLocal(&file_name) || !js_new_string(js_isolate, contents).ToLocal(&source))
+    {
+        pd_error(x, "Error reading '%s'.", path.c_str());
+        return false;
+    }
+
+    v8::ScriptOrigin origin(file_name);
+    auto hash = std::hash<string>()(contents);
+    auto cache = js_read_code_cache(path, kind, hash);
+    auto options = cache != nullptr ? v8::ScriptCompiler::kConsumeCodeCache : v8::ScriptCompiler::kNoCompileOptions;
+    v8::ScriptCompiler::Source src(source, origin, cache);
+
+    if (!v8::ScriptCompiler::CompileFunctionInContext(context, &src, param_count, params, extension_count, extensions, options).ToLocal(&function))
+    {
+        pd_error(x, "Error compiling '%s':\n%s", path.c_str(), js_get_exception_msg(js_isolate, &trycatch).c_str());
+        return false;
+    }
+
+    auto produce_cache = cache == nullptr || src.GetCachedData()->rejected;
+
+    v8::Local<v8::Value> result;
+    if (!function->Call(context, recv, argc, argv).ToLocal(&result))
+    {
+        pd_error(x, "Error running '%s':\n%s", path.c_str(), js_get_exception_msg(js_isolate, &trycatch).c_str());
+        return false;
+    }
+
+    if (produce_cache)
+        js_write_code_cache(path, kind, hash, v8::ScriptCompiler::CreateCodeCacheForFunction(function));
+
+    return true;
+}
+
+// Private symbol under which a module object stores the instance that loaded it.
+static v8::Local<v8::Private> js_module_owner_key(v8::Isolate* isolate)
+{
+    static v8::Eternal<v8::Private> key;
+
+    if (key.IsEmpty())
+        key.Set(isolate, v8::Private::New(isolate, v8::String::NewFromUtf8Literal(isolate, "owner")));
+
+    return key.Get(isolate);
+}
+
+// Evaluates the module file once per isolate in the module context, later calls (also
+// from other instances) get the cached module object. The module is registered before
+// it runs so that a require cycle sees the partially filled exports, as in CommonJS.
+// Errors are reported on x, which is null for requires from other modules.
+static v8::MaybeLocal<v8::Object> js_require_module(t_js* x, v8::Local<v8::Context> context, const js_file& file)
+{
+    v8::Context::Scope context_scope(context);
+    auto modules = js_modules->Get(js_isolate);
+    v8::Local<v8::String> id;
+    v8::Local<v8::String> dir;
+    v8::Local<v8::Value> cached;
+
+    if (!js_new_string(js_isolate, file.path).ToLocal(&id) || !js_new_string(js_isolate, file.dir).ToLocal(&dir)
+        || !modules->Get(context, id).ToLocal(&cached))
+    {
+        return v8::MaybeLocal<v8::Object>();
+    }
+
+    if (cached->IsObject())
+        return v8::Local<v8::Object>::Cast(cached);
+
+    string contents;
+
+    if (!js_readfile(file.path.c_str(), contents))
+    {
+        pd_error(x, "Error reading '%s'.", file.path.c_str());
+        return v8::MaybeLocal<v8::Object>();
+    }
+
+    auto module = v8::Object::New(js_isolate);
+    auto exports = v8::Object::New(js_isolate);
+    auto loadedKey = v8::String::NewFromUtf8Literal(js_isolate, "loaded");
+
+    if (module->Set(context, v8::String::NewFromUtf8Literal(js_isolate, "id"), id).IsNothing()
+        || module->Set(context, v8::String::NewFromUtf8Literal(js_isolate, "exports"), exports).IsNothing()
+        || module->Set(context, loadedKey, v8::False(js_isolate)).IsNothing()
+        || module->SetPrivate(context, js_module_owner_key(js_isolate), v8::External::New(js_isolate, js_module_loader)).IsNothing()
+        || modules->Set(context, id, module).IsNothing())
+    {
+        return v8::MaybeLocal<v8::Object>();
+    }
+
+    v8::Local<v8::String> params[] = {
+        v8::String::NewFromUtf8Literal(js_isolate, "exports"),
+        v8::String::NewFromUtf8Literal(js_isolate, "module"),
+        v8::String::NewFromUtf8Literal(js_isolate, "__filename"),
+        v8::String::NewFromUtf8Literal(js_isolate, "__dirname")
+    };
+    v8::Local<v8::Value> argv[] = { exports, module, id, dir };
+
+    if (!js_call_file(x, context, file.path, contents, JS_CACHE_MODULE, 4, params, 0, NULL, exports, 4, argv))
+    {
+        // like node, a module that failed is evaluated again by the next require
+        modules->Delete(context, id).FromMaybe(false);
+        return v8::MaybeLocal<v8::Object>();
+    }
+
+    module->Set(context, loadedKey, v8::True(js_isolate)).FromMaybe(false);
+
+    return module;
+}
+
+// Drops the entry modules of x, which reference its globals. With reload the shared
+// CommonJS and ES modules x has loaded are dropped as well, so that they're evaluated
+// again after x recompiles.
+static void js_release_modules(t_js* x, bool reload)
+{
+    v8::Local<v8::Array> ids;
+
+    for (auto it = js_esmodules.begin(); it != js_esmodules.end();)
+    {
+        if (it->second.owner == x && (it->second.entry || reload))
+        {
+            auto shared = js_esmodule_map.find(it->second.path);
+            if (shared != js_esmodule_map.end() && shared->second == it->second.module)
+                js_esmodule_map.erase(shared);
+            it = js_esmodules.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (!reload || js_module_context.IsEmpty())
+        return;
+
+    auto context = js_module_context.Get(js_isolate);
+    v8::Context::Scope context_scope(context);
+    auto modules = js_modules->Get(js_isolate);
+
+    if (!modules->GetOwnPropertyNames(context).ToLocal(&ids))
+        return;
+
+    for (uint32_t i = 0; i < ids->Length(); i++)
+    {
+        v8::Local<v8::Value> id;
+        v8::Local<v8::Value> module;
+        v8::Local<v8::Value> owner;
+
+        if (ids->Get(context, i).ToLocal(&id) && modules->Get(context, id).ToLocal(&module) && module->IsObject()
+            && v8::Local<v8::Object>::Cast(module)->GetPrivate(context, js_module_owner_key(js_isolate)).ToLocal(&owner)
+            && owner->IsExternal() && v8::Local<v8::External>::Cast(owner)->Value() == x)
+        {
+            modules->Delete(context, id).FromMaybe(false);
+        }
+    }
+}
+
+static bool js_is_esmodule(const string& path)
+{
+    return path.size() > 4 && path.compare(path.size() - 4, 4, ".mjs") == 0;
+}
+
+// Canonical path, so that a module imported through different relative paths is loaded once.
+static string js_normalize_path(const string& path)
+{
+#if WIN32
+    char full[MAX_PATH];
+    if (_fullpath(full, path.c_str(), MAX_PATH) == NULL)
+        return path;
+#else
+    char full[PATH_MAX];
+    if (realpath(path.c_str(), full) == NULL)
+        return path;
+#endif
+    string result(full);
+    replace(result.begin(), result.end(), '\\', '/');
+    return result;
+}
+
+static const string* js_esmodule_path(v8::Local<v8::Module> module)
+{
+    auto range = js_esmodules.equal_range(module->GetIdentityHash());
+
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (it->second.module == module)
+            return &it->second.path;
+    }
+
+    return nullptr;
+}
+
+static v8::MaybeLocal<v8::Module> js_compile_esmodule(t_js* owner, bool entry, const string& path)
+{
+    string contents;
+    v8::Local<v8::String> file_name;
+    v8::Local<v8::String> source;
+    v8::Local<v8::Module> module;
+
+    if (!js_readfile(path.c_str(), contents) || !js_new_string(js_isolate, path).ToLocal(&file_name)
+        || !js_new_string(js_isolate, contents).ToLocal(&source))
+    {
+        js_throw_error(js_isolate, string("Error reading '") + path + "'.");
+        return v8::MaybeLocal<v8::Module>();
+    }
+
+    v8::ScriptOrigin origin(file_name, v8::Local<v8::Integer>(), v8::Local<v8::Integer>(), v8::Local<v8::Boolean>(),
+        v8::Local<v8::Integer>(), v8::Local<v8::Value>(), v8::False(js_isolate), v8::False(js_isolate), v8::True(js_isolate));
+    auto hash = std::hash<string>()(contents);
+    auto cache = js_read_code_cache(path, JS_CACHE_ESMODULE, hash);
+    auto options = cache != nullptr ? v8::ScriptCompiler::kConsumeCodeCache : v8::ScriptCompiler::kNoCompileOptions;
+    v8::ScriptCompiler::Source src(source, origin, cache);
+
+    if (!v8::ScriptCompiler::CompileModule(js_isolate, &src, options).ToLocal(&module))
+        return v8::MaybeLocal<v8::Module>();
+
+    // module caches have to be created before the module is evaluated
+    if (cache == nullptr || src.GetCachedData()->rejected)
+        js_write_code_cache(path, JS_CACHE_ESMODULE, hash, v8::ScriptCompiler::CreateCodeCache(module->GetUnboundModuleScript()));
+
+    t_js_esmodule info;
+    info.path = path;
+    info.owner = owner;
+    info.entry = entry;
+    info.module.Reset(js_isolate, module);
+    js_esmodules.emplace(module->GetIdentityHash(), std::move(info));
+
+    return module;
+}
+
+// Resolves an import specifier. Relative specifiers are looked up next to the importing
+// file, others on the Pd search path of the patch, or of the importing file for imports
+// from shared modules (x is null). Imported modules are compiled once and shared by all instances.
+static v8::MaybeLocal<v8::Module> js_find_esmodule(t_js* x, const string& from, v8::Local<v8::String> specifier)
+{
+    auto name = js_object_to_string(js_isolate, specifier);
+    auto relative = name.compare(0, 2, "./") == 0 || name.compare(0, 3, "../") == 0;
+    auto dir = (relative || x == nullptr) && from.find('/') != string::npos ? from.substr(0, from.find_last_of('/'))
+        : x != nullptr ? string(canvas_getdir(x->canvas)->s_name) : string(".");
+    js_file file;
+
+    if (!js_openpath(dir.c_str(), name.c_str(), &file))
+    {
+        js_throw_error(js_isolate, string("Cannot find module '") + name + "'.");
+        return v8::MaybeLocal<v8::Module>();
+    }
+
+    auto path = js_normalize_path(file.path);
+    auto it = js_esmodule_map.find(path);
+
+    if (it != js_esmodule_map.end())
+        return it->second.Get(js_isolate);
+
+    v8::Local<v8::Module> module;
+
+    if (!js_compile_esmodule(js_module_loader, false, path).ToLocal(&module))
+        return v8::MaybeLocal<v8::Module>();
+
+    js_esmodule_map[path].Reset(js_isolate, module);
+
+    return module;
+}
+
+static v8::MaybeLocal<v8::Module> js_resolve_esmodule(v8::Local<v8::Context> context, v8::Local<v8::String> specifier, v8::Local<v8::Module> referrer)
+{
+    auto x = (t_js*)context->GetAlignedPointerFromEmbedderData(js_context_owner);
+    auto from = js_esmodule_path(referrer);
+
+    return js_find_esmodule(x, from != nullptr ? *from : string(), specifier);
+}
+
+// A module that failed to evaluate stays errored, drop it so the next import retries.
+static void js_drop_errored_esmodules()
+{
+    for (auto it = js_esmodule_map.begin(); it != js_esmodule_map.end();)
+    {
+        if (it->second.Get(js_isolate)->GetStatus() == v8::Module::kErrored)
+            it = js_esmodule_map.erase(it);
+        else
+            ++it;
+    }
+}
+
+static v8::MaybeLocal<v8::Value> js_evaluate_esmodule(v8::Local<v8::Context> context, v8::Local<v8::Module> module)
+{
+    if (module->GetStatus() == v8::Module::kUninstantiated
+        && !module->InstantiateModule(context, js_resolve_esmodule).FromMaybe(false))
+    {
+        return v8::MaybeLocal<v8::Value>();
+    }
+
+    if (module->GetStatus() == v8::Module::kInstantiated)
+    {
+        v8::Local<v8::Value> result;
+
+        if (!module->Evaluate(context).ToLocal(&result))
+        {
+            js_drop_errored_esmodules();
+            return v8::MaybeLocal<v8::Value>();
+        }
+    }
+    else if (module->GetStatus() == v8::Module::kErrored)
+    {
+        js_isolate->ThrowException(module->GetException());
+        return v8::MaybeLocal<v8::Value>();
+    }
+
+    return module->GetModuleNamespace();
+}
+
+// Imports a shared module and evaluates it in the module context, so that its graph never
+// links against an instance context. Returns the module namespace.
+static v8::MaybeLocal<v8::Value> js_import_esmodule(t_js* x, const string& from, v8::Local<v8::String> specifier)
+{
+    v8::Local<v8::Module> module;
+
+    if (!js_find_esmodule(x, from, specifier).ToLocal(&module))
+        return v8::MaybeLocal<v8::Value>();
+
+    auto context = js_get_module_context();
+    v8::Context::Scope context_scope(context);
+
+    return js_evaluate_esmodule(context, module);
+}
+
+static v8::MaybeLocal<v8::Promise> js_import_dynamic(v8::Local<v8::Context> context, v8::Local<v8::ScriptOrModule> referrer,
+    v8::Local<v8::String> specifier)
+{
+    auto x = (t_js*)context->GetAlignedPointerFromEmbedderData(js_context_owner);
+    v8::Local<v8::Promise::Resolver> resolver;
+
+    if (!v8::Promise::Resolver::New(context).ToLocal(&resolver))
+        return v8::MaybeLocal<v8::Promise>();
+
+    v8::TryCatch trycatch(js_isolate);
+    v8::Local<v8::Value> ns;
+    auto from = js_object_to_string(js_isolate, referrer->GetResourceName());
+    auto loader = js_module_loader;
+
+    if (x != nullptr)
+        js_module_loader = x;
+
+    js_watch_load_begin();
+    auto imported = js_import_esmodule(x, from, specifier).ToLocal(&ns);
+    js_watch_end();
+    js_module_loader = loader;
+
+    if (imported)
+    {
+        resolver->Resolve(context, ns).FromMaybe(false);
+    }
+    else if (trycatch.HasCaught())
+    {
+        resolver->Reject(context, trycatch.Exception()).FromMaybe(false);
+    }
+
+    return resolver->GetPromise();
+}
+
+static void js_import_meta(v8::Local<v8::Context> context, v8::Local<v8::Module> module, v8::Local<v8::Object> meta)
+{
+    auto path = js_esmodule_path(module);
+    v8::Local<v8::String> url;
+
+    if (path != nullptr && js_new_string(js_isolate, "file://" + *path).ToLocal(&url))
+        meta->CreateDataProperty(context, v8::String::NewFromUtf8Literal(js_isolate, "url"), url).FromMaybe(false);
+}
+
+// Runs an .mjs entry script. Entry modules are compiled per instance because their
+// handlers refer to the instance's globals; named exports become global functions.
+// The modules it imports are evaluated in the module context first, so that instantiating
+// the entry only links against them.
+static bool js_run_esmodule(t_js* x, v8::Local<v8::Context> context, const string& path)
+{
+    v8::TryCatch trycatch(js_isolate);
+    v8::Local<v8::Module> module;
+    v8::Local<v8::Value> ns;
+    v8::Local<v8::Array> names;
+    auto normalized = js_normalize_path(path);
+
+    if (!js_compile_esmodule(x, true, normalized).ToLocal(&module))
+    {
+        pd_error(&x->x_obj, "Error compiling '%s':\n%s", path.c_str(), js_get_exception_msg(js_isolate, &trycatch).c_str());
+        return false;
+    }
+
+    auto loader = js_module_loader;
+    auto imported = true;
+
+    js_module_loader = x;
+    for (int i = 0; imported && i < module->GetModuleRequestsLength(); i++)
+        imported = !js_import_esmodule(x, normalized, module->GetModuleRequest(i)).IsEmpty();
+    js_module_loader = loader;
+
+    if (!imported || !js_evaluate_esmodule(context, module).ToLocal(&ns))
+    {
+        pd_error(&x->x_obj, "Error running '%s':\n%s", path.c_str(), js_get_exception_msg(js_isolate, &trycatch).c_str());
+        return false;
+    }
+
+    auto exports = v8::Local<v8::Object>::Cast(ns);
+
+    if (!exports->GetOwnPropertyNames(context).ToLocal(&names))
+        return false;
+
+    for (uint32_t i = 0; i < names->Length(); i++)
+    {
+        v8::Local<v8::Value> name;
+        v8::Local<v8::Value> value;
+
+        if (names->Get(context, i).ToLocal(&name) && js_object_to_string(js_isolate, name) != "default"
+            && exports->Get(context, name).ToLocal(&value))
+        {
+            context->Global()->Set(context, name, value).FromMaybe(false);
+        }
+    }
+
+    return true;
+}
+
+static void js_include(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    if (args.Length() < 1) return;
+
+    v8::Isolate* isolate = args.GetIsolate();
+    v8::HandleScope scope(isolate);
     v8::Local<v8::External> f = v8::Local<v8::External>::Cast(args.Data());
     auto x = (t_js*)f->Value();
 
     if (args.Length() > 0 && args[0]->IsString())
     {
-        // pass { exports: {} };
         auto script_name = js_object_to_string(isolate, args[0]);
-        v8::Local<v8::Object> o = v8::Object::New(isolate);
-        auto exportsKey = v8::String::NewFromUtf8Literal(isolate, "exports");
-        if (!(o->Set(context, exportsKey, v8::Object::New(isolate)).IsNothing())
-            && js_load(x, script_name.c_str(), false, &o) != NULL)
+        v8::Local<v8::Object> global;
+        if (args.Length() > 1 && args[1]->IsObject())
+            global = v8::Local<v8::Object>::Cast(args[1]);
+        js_watch_load_begin();
+        js_load(x, script_name.c_str(), false, (global.IsEmpty() ? NULL : &global));
+        js_watch_end();
+    }
+}
+
+static void js_require_exports(const v8::FunctionCallbackInfo<v8::Value>& args, t_js* x, const js_file& file)
+{
+    v8::Isolate* isolate = args.GetIsolate();
+    v8::EscapableHandleScope scope(isolate);
+    v8::Local<v8::Context> context = js_get_module_context();
+    v8::Local<v8::Object> module;
+    v8::Local<v8::Value> exports;
+
+    js_watch_load_begin();
+    auto loaded = !file.path.empty() && js_require_module(x, context, file).ToLocal(&module)
+        && module->Get(context, v8::String::NewFromUtf8Literal(isolate, "exports")).ToLocal(&exports);
+    js_watch_end();
+
+    if (loaded)
+    {
+        args.GetReturnValue().Set(scope.Escape(exports));
+        return;
+    }
+
+    args.GetReturnValue().SetUndefined();
+}
+
+static void js_require(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    v8::Isolate* isolate = args.GetIsolate();
+    v8::Local<v8::External> f = v8::Local<v8::External>::Cast(args.Data());
+    auto x = (t_js*)f->Value();
+
+    if (args.Length() > 0 && args[0]->IsString())
+    {
+        auto script_name = js_object_to_string(isolate, args[0]);
+        auto loader = js_module_loader;
+
+        js_module_loader = x;
+        js_require_exports(args, x, js_getfile(x, script_name.c_str()));
+        js_module_loader = loader;
+        return;
+    }
+
+    args.GetReturnValue().SetUndefined();
+}
+
+// require as seen by modules, names are looked up next to the calling module's file
+// and then on the Pd search path.
+static void js_module_require(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    v8::Isolate* isolate = args.GetIsolate();
+    v8::HandleScope scope(isolate);
+
+    if (args.Length() > 0 && args[0]->IsString())
+    {
+        auto script_name = js_object_to_string(isolate, args[0]);
+        auto frames = v8::StackTrace::CurrentStackTrace(isolate, 1, v8::StackTrace::kScriptName);
+        string dir = ".";
+        js_file file;
+
+        if (frames->GetFrameCount() > 0 && !frames->GetFrame(isolate, 0)->GetScriptName().IsEmpty())
         {
-            v8::Local<v8::Value> exports;
-            if (o->Get(context, exportsKey).ToLocal(&exports))
-            {
-                args.GetReturnValue().Set(scope.Escape(exports));
-                return;
-            }
+            auto from = js_object_to_string(isolate, frames->GetFrame(isolate, 0)->GetScriptName());
+            auto slash = from.find_last_of('/');
+            if (slash != string::npos)
+                dir = from.substr(0, slash);
         }
+
+        if (!js_openpath(dir.c_str(), script_name.c_str(), &file))
+            pd_error(nullptr, "Script file '%s' not found.", script_name.c_str());
+
+        js_require_exports(args, nullptr, file);
+        return;
     }
 
     args.GetReturnValue().SetUndefined();
 }
 
+// Per-instance globals that modules don't have. Using one throws an error that names it
+// instead of a bare ReferenceError, so scripts written before modules were shared can
+// see what to pass in.
+static const char* js_instance_globals[] = {
+    "inlets", "outlets", "inlet", "messagename", "jsarguments", "typedlists", "outlet", "include",
+    "setTimeout", "setInterval", "clearTimeout", "clearInterval", "Task"
+};
+
+static void js_throw_instance_global(v8::Isolate* isolate, v8::Local<v8::Name> property)
+{
+    auto name = js_object_to_string(isolate, property);
+    js_throw_error(isolate, "'" + name + "' belongs to a js object and is not available in modules, "
+        "pass it from the script instead, e.g. require(\"module.js\")(" + name + ")");
+}
+
+static void js_instance_global_getter(v8::Local<v8::Name> property, const v8::PropertyCallbackInfo<v8::Value>& info)
+{
+    js_throw_instance_global(info.GetIsolate(), property);
+}
+
+static void js_instance_global_setter(v8::Local<v8::Name> property, v8::Local<v8::Value> value, const v8::PropertyCallbackInfo<void>& info)
+{
+    js_throw_instance_global(info.GetIsolate(), property);
+}
+
+// Context that shared modules are evaluated in. It has none of the per-instance globals
+// (outlet, inlets, timers), so a module never refers to the object that happened to load
+// it first and may outlive it.
+static v8::Local<v8::Context> js_get_module_context()
+{
+    if (!js_module_context.IsEmpty())
+        return js_module_context.Get(js_isolate);
+
+    v8::Local<v8::ObjectTemplate> global_templ = v8::ObjectTemplate::New(js_isolate);
+    v8::Local<v8::External> none = v8::External::New(js_isolate, nullptr);
+    global_templ->Set(js_isolate, "post", v8::FunctionTemplate::New(js_isolate, js_post));
+    global_templ->Set(js_isolate, "error", v8::FunctionTemplate::New(js_isolate, js_error, none));
+    global_templ->Set(js_isolate, "cpost", v8::FunctionTemplate::New(js_isolate, js_cpost));
+    global_templ->Set(js_isolate, "require", v8::FunctionTemplate::New(js_isolate, js_module_require));
+    global_templ->Set(js_isolate, "PdArray", js_pdarray_template(js_isolate));
+    global_templ->Set(js_isolate, "messnamed", v8::FunctionTemplate::New(js_isolate, js_messnamed, none));
+    for (auto name : js_instance_globals)
+        global_templ->SetAccessor(v8::String::NewFromUtf8(js_isolate, name, v8::NewStringType::kInternalized).ToLocalChecked(),
+            js_instance_global_getter, js_instance_global_setter, v8::Local<v8::Value>(), v8::DEFAULT, v8::DontEnum);
+
+    auto context = v8::Context::New(js_isolate, nullptr, global_templ);
+    context->SetSecurityToken(v8::Int32::New(js_isolate, 0));
+    context->SetAlignedPointerInEmbedderData(js_context_owner, nullptr);
+    js_module_context.Set(js_isolate, context);
+
+    v8::Context::Scope context_scope(context);
+    v8::Local<v8::Value> require;
+
+    js_global = new v8::Eternal<v8::Object>(js_isolate, v8::Object::New(js_isolate));
+    js_modules = new v8::Eternal<v8::Object>(js_isolate, v8::Object::New(js_isolate, v8::Null(js_isolate), nullptr, nullptr, 0));
+
+    if (!context->Global()->Get(context, v8::String::NewFromUtf8Literal(js_isolate, "require")).ToLocal(&require)
+        || !require->IsObject()
+        || v8::Local<v8::Object>::Cast(require)->Set(context, v8::String::NewFromUtf8Literal(js_isolate, "cache"), js_modules->Get(js_isolate)).IsNothing())
+    {
+        pd_error(nullptr, "Error defining 'require.cache'.");
+    }
+
+    if (context->Global()->DefineOwnProperty(context, v8::String::NewFromUtf8Literal(js_isolate, "__global__"),
+        js_global->Get(js_isolate), static_cast<v8::PropertyAttribute>(v8::ReadOnly | v8::DontDelete)).IsNothing())
+    {
+        pd_error(nullptr, "Error defining '__global__'.");
+    }
+
+    return context;
+}
+
 static t_js *js_load(t_js* x, const char *script_name = NULL, bool create_context = true, const v8::Local<v8::Object> *global = NULL)
 {
     string path;
@@ -709,96 +3113,336 @@ static t_js *js_load(t_js* x, const char *script_name = NULL, bool create_contex
         if (create_context)
         {
             v8::Local<v8::ObjectTemplate> global_templ = v8::ObjectTemplate::New(js_isolate);
-            global_templ->SetHandler(v8::NamedPropertyHandlerConfiguration(js_get, js_set, nullptr, nullptr, nullptr, v8::External::New(js_isolate, x)));
+            v8::Local<v8::External> data = v8::External::New(js_isolate, x);
+            // plain accessors instead of an interceptor so global access stays on V8's fast paths
+            global_templ->SetAccessor(v8::String::NewFromUtf8Literal(js_isolate, "inlets"), js_inlets_getter, js_inlets_setter, data, v8::DEFAULT, v8::DontDelete);
+            global_templ->SetAccessor(v8::String::NewFromUtf8Literal(js_isolate, "outlets"), js_outlets_getter, js_outlets_setter, data, v8::DEFAULT, v8::DontDelete);
+            global_templ->SetAccessor(v8::String::NewFromUtf8Literal(js_isolate, "inlet"), js_inlet_getter, nullptr, data, v8::DEFAULT, v8::DontDelete);
+            global_templ->SetAccessor(v8::String::NewFromUtf8Literal(js_isolate, "messagename"), js_messagename_getter, nullptr, data, v8::DEFAULT, v8::DontDelete);
+            global_templ->SetAccessor(v8::String::NewFromUtf8Literal(js_isolate, "jsarguments"), js_jsarguments_getter, nullptr, data, v8::DEFAULT, v8::DontDelete);
+            global_templ->SetAccessor(v8::String::NewFromUtf8Literal(js_isolate, "typedlists"), js_typedlists_getter, js_typedlists_setter, data, v8::DEFAULT, v8::DontDelete);
             global_templ->Set(js_isolate, "post", v8::FunctionTemplate::New(js_isolate, js_post));
             global_templ->Set(js_isolate, "error", v8::FunctionTemplate::New(js_isolate, js_error, v8::External::New(js_isolate, x)));
             global_templ->Set(js_isolate, "cpost", v8::FunctionTemplate::New(js_isolate, js_cpost));
             global_templ->Set(js_isolate, "outlet", v8::FunctionTemplate::New(js_isolate, js_outlet, v8::External::New(js_isolate, x)));
             global_templ->Set(js_isolate, "include", v8::FunctionTemplate::New(js_isolate, js_include, v8::External::New(js_isolate, x)));
             global_templ->Set(js_isolate, "require", v8::FunctionTemplate::New(js_isolate, js_require, v8::External::New(js_isolate, x)));
+            global_templ->Set(js_isolate, "PdArray", js_pdarray_template(js_isolate));
+            global_templ->Set(js_isolate, "setTimeout", v8::FunctionTemplate::New(js_isolate, js_set_timeout, data));
+            global_templ->Set(js_isolate, "setInterval", v8::FunctionTemplate::New(js_isolate, js_set_interval, data));
+            global_templ->Set(js_isolate, "clearTimeout", v8::FunctionTemplate::New(js_isolate, js_clear_timeout, data));
+            global_templ->Set(js_isolate, "clearInterval", v8::FunctionTemplate::New(js_isolate, js_clear_timeout, data));
+            global_templ->Set(js_isolate, "Task", js_task_template(js_isolate, data));
             global_templ->Set(js_isolate, "messnamed", v8::FunctionTemplate::New(js_isolate, js_messnamed, v8::External::New(js_isolate, x)));
 
-            context = v8::Context::New(js_isolate, nullptr, global_templ);
-            if (x->context == nullptr)
-                x->context = new v8::Persistent<v8::Context>(js_isolate, context);
-            else
-                x->context->Reset(js_isolate, context);
+            context = v8::Context::New(js_isolate, nullptr, global_templ);
+            if (x->context == nullptr)
+                x->context = new v8::Persistent<v8::Context>(js_isolate, context);
+            else
+                x->context->Reset(js_isolate, context);
+
+            context->SetSecurityToken(v8::Int32::New(js_isolate, 0));
+            context->SetAlignedPointerInEmbedderData(js_context_owner, x);
+
+            x->outlet_handles = 0;
+            js_update_outlet_handles(x);
+        }
+        else
+        {
+            context = x->context->Get(js_isolate);
+        }
+
+        // creates the shared globals before the first instance refers to them
+        js_get_module_context();
+
+        v8::Context::Scope context_scope(context);
+        {
+            v8::Local<v8::Value> require;
+
+            if (create_context
+                && (!context->Global()->Get(context, v8::String::NewFromUtf8Literal(js_isolate, "require")).ToLocal(&require)
+                    || !require->IsObject()
+                    || v8::Local<v8::Object>::Cast(require)->Set(context, v8::String::NewFromUtf8Literal(js_isolate, "cache"), js_modules->Get(js_isolate)).IsNothing()))
+            {
+                pd_error(&x->x_obj, "Error defining 'require.cache'.");
+            }
+
+            if (create_context
+                && context->Global()->DefineOwnProperty(context, v8::String::NewFromUtf8Literal(js_isolate, "__global__"),
+                    js_global->Get(js_isolate), static_cast<v8::PropertyAttribute>(v8::ReadOnly | v8::DontDelete)).IsNothing())
+            {
+                pd_error(&x->x_obj, "Error defining '__global__'.");
+            }
+
+            string contents;
+
+            if (path.empty())
+                return x;
+
+            if (!js_readfile(path.c_str(), contents))
+            {
+                pd_error(&x->x_obj, "Error reading '%s'.", path.c_str());
+                return x;
+            }
+
+            v8::TryCatch trycatch(js_isolate);
+            v8::Local<v8::String> file_name = v8::String::NewFromUtf8(js_isolate, path.c_str(), v8::NewStringType::kNormal).ToLocalChecked();
+            v8::ScriptOrigin origin(file_name);
+
+            if (global == NULL && js_is_esmodule(path))
+            {
+                js_run_esmodule(x, context, path);
+            }
+            else if (global == NULL)
+            {
+                auto hash = std::hash<string>()(contents);
+                v8::Local<v8::UnboundScript> script;
+                bool produce_cache;
+
+                if (!js_compile_script(path, contents, hash, origin, &produce_cache).ToLocal(&script))
+                {
+                    pd_error(&x->x_obj, "Error compiling '%s':\n%s", path.c_str(), js_get_exception_msg(js_isolate, &trycatch).c_str());
+                    return x;
+                }
+
+                v8::Local<v8::Value> result;
+                if (!script->BindToCurrentContext()->Run(context).ToLocal(&result))
+                {
+                    pd_error(&x->x_obj, "Error running '%s':\n%s", path.c_str(), js_get_exception_msg(js_isolate, &trycatch).c_str());
+                    return x;
+                }
+
+                // after running, so functions compiled lazily during the first run are included
+                if (produce_cache)
+                    js_write_code_cache(path, JS_CACHE_SCRIPT, hash, v8::ScriptCompiler::CreateCodeCache(script));
+            }
+            else
+            {
+                v8::Local<v8::Object> extensions[] = { *global };
+
+                js_call_file(x, context, path, contents, JS_CACHE_FUNCTION, 0, NULL, 1, extensions, *global, 0, NULL);
+            }
+        }
+    }
+
+    return x;
+}
+
+// Prefix of the counters js~ posts, objects without a script have no path.
+static const char* js_post_name(const t_js* x)
+{
+    return x->path.empty() ? "js~" : x->path.c_str();
+}
+
+static void js_tilde_dspstats(t_js* x, bool reset)
+{
+    auto& stats = x->dspstats;
+
+    if (reset)
+    {
+        stats = t_js_dspstats();
+        return;
+    }
+
+    post("%s: %llu blocks, %.1f us last, %.1f us average, %.1f us max, %llu overruns (%.1f us per block)",
+        js_post_name(x), (unsigned long long)stats.blocks, stats.last_us,
+        stats.blocks > 0 ? stats.total_us / stats.blocks : 0.0, stats.max_us,
+        (unsigned long long)stats.overruns, x->block_us);
+    post("%s: %llu array buffers, %llu garbage collections during perform, %.0f bytes JS heap allocated per block (%llu blocks sampled)",
+        js_post_name(x), (unsigned long long)stats.buffers, (unsigned long long)stats.gcs,
+        stats.heap_samples > 0 ? (double)stats.heap_bytes / stats.heap_samples : 0.0,
+        (unsigned long long)stats.heap_samples);
+}
+
+// Detaches the views of the previous DSP chain, whose buffers Pd is about to free,
+// so scripts that kept a reference see empty arrays instead of freed memory.
+static void js_tilde_release(t_js* x)
+{
+    for (auto& buffer : x->signal_buffers)
+    {
+        auto b = buffer.Get(js_isolate);
+
+        if (b->IsDetachable())
+            b->Detach();
+    }
+
+    x->signal_buffers.clear();
+    x->signal_inputs.Reset();
+    x->signal_outputs.Reset();
+    x->signal_out.clear();
+    x->perform.Reset();
+}
+
+// CPU profiles sample all js objects, as they share one isolate. Profiles started
+// by a js object are titled after it, so objects and the global pdjs receiver can
+// profile overlapping stretches of time.
+static v8::CpuProfiler* js_profiler = nullptr;
+static int js_profile_interval = 1000; // sampling interval in us
+
+static string js_profile_title(t_js* x)
+{
+    // not the path, which compile may change while the profile is running
+    ostringstream os;
+    os << "js@" << (void*)x;
+    return os.str();
+}
+
+static void js_profile_start(const string& title)
+{
+    v8::HandleScope handle_scope(js_isolate);
+
+    if (js_profiler == nullptr)
+        js_profiler = v8::CpuProfiler::New(js_isolate);
+
+    js_profiler->SetSamplingInterval(js_profile_interval);
+    js_profiler->StartProfiling(v8::String::NewFromUtf8(js_isolate, title.c_str()).ToLocalChecked(), true);
+}
+
+static void js_profile_json_string(ostringstream& os, const char* s)
+{
+    os << '"';
+
+    for (; *s != 0; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            os << '\\' << *s;
+        else if ((unsigned char)*s < 0x20)
+            os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)*s << std::dec;
+        else
+            os << *s;
+    }
+
+    os << '"';
+}
+
+static void js_profile_json_node(ostringstream& os, const v8::CpuProfileNode* node)
+{
+    // DevTools counts lines and columns from 0, V8 from 1 with 0 for none
+    os << "{\"id\":" << node->GetNodeId() << ",\"callFrame\":{\"functionName\":";
+    js_profile_json_string(os, node->GetFunctionNameStr());
+    os << ",\"scriptId\":\"" << node->GetScriptId() << "\",\"url\":";
+    js_profile_json_string(os, node->GetScriptResourceNameStr());
+    os << ",\"lineNumber\":" << node->GetLineNumber() - 1 << ",\"columnNumber\":" << node->GetColumnNumber() - 1
+        << "},\"hitCount\":" << node->GetHitCount() << ",\"children\":[";
+
+    for (int i = 0; i < node->GetChildrenCount(); i++)
+        os << (i > 0 ? "," : "") << node->GetChild(i)->GetNodeId();
+
+    os << "]}";
+
+    for (int i = 0; i < node->GetChildrenCount(); i++)
+    {
+        os << ",";
+        js_profile_json_node(os, node->GetChild(i));
+    }
+}
+
+// Stops the profile title and writes it to path in the .cpuprofile format of Chrome
+// DevTools, or discards it if path is empty.
+static void js_profile_stop(t_object* owner, const string& title, const string& path)
+{
+    v8::HandleScope handle_scope(js_isolate);
+    auto profile = js_profiler == nullptr ? nullptr
+        : js_profiler->StopProfiling(v8::String::NewFromUtf8(js_isolate, title.c_str()).ToLocalChecked());
+
+    if (profile == nullptr)
+    {
+        pd_error(owner, "No profile is running.");
+        return;
+    }
+
+    if (!path.empty())
+    {
+        ostringstream os;
+        auto last = profile->GetStartTime();
+
+        os << "{\"nodes\":[";
+        js_profile_json_node(os, profile->GetTopDownRoot());
+        os << "],\"startTime\":" << profile->GetStartTime() << ",\"endTime\":" << profile->GetEndTime() << ",\"samples\":[";
+
+        for (int i = 0; i < profile->GetSamplesCount(); i++)
+            os << (i > 0 ? "," : "") << profile->GetSample(i)->GetNodeId();
 
-            context->SetSecurityToken(v8::Int32::New(js_isolate, 0));
-        }
-        else
-        {
-            context = x->context->Get(js_isolate);
-        }
+        os << "],\"timeDeltas\":[";
 
-        v8::Context::Scope context_scope(context);
+        for (int i = 0; i < profile->GetSamplesCount(); i++)
         {
-            if (js_global == nullptr)
-            {
-                js_global = new v8::Eternal<v8::Object>(js_isolate, v8::Object::New(js_isolate));
-            }
+            os << (i > 0 ? "," : "") << profile->GetSampleTimestamp(i) - last;
+            last = profile->GetSampleTimestamp(i);
+        }
 
-            v8::Local<v8::String> source;
+        os << "]}";
 
-            if (path.empty())
-                return x;
+        auto json = os.str();
+        auto f = fopen(path.c_str(), "wb");
+        auto ok = f != NULL && fwrite(json.data(), 1, json.size(), f) == json.size();
 
-            if (!js_readfile(js_isolate, path.c_str()).ToLocal(&source))
-            {
-                pd_error(&x->x_obj, "Error reading '%s'.", path.c_str());
-                return x;
-            }
+        if (f != NULL)
+            fclose(f);
 
-            v8::TryCatch trycatch(js_isolate);
-            v8::Local<v8::String> file_name = v8::String::NewFromUtf8(js_isolate, path.c_str(), v8::NewStringType::kNormal).ToLocalChecked();
-            v8::ScriptOrigin origin(file_name);
+        if (ok)
+            post("js: profile written to %s", path.c_str());
+        else
+            pd_error(owner, "Error writing profile '%s'.", path.c_str());
+    }
 
-            if (global == NULL)
-            {
-                v8::Local<v8::Script> script;
+    profile->Delete();
+}
 
-                if (!v8::Script::Compile(context, source, &origin).ToLocal(&script))
-                {
-                    pd_error(&x->x_obj, "Error compiling '%s':\n%s", path.c_str(), js_get_exception_msg(js_isolate, &trycatch).c_str());
-                    return x;
-                }
+// profile start, profile stop [file] and profile interval <us>; a relative file is
+// written to dir.
+static void js_profile(t_object* owner, const string& title, const string& dir, bool& running, int argc, const t_atom* argv)
+{
+    auto action = argc > 0 ? atom_getsymbol(&argv[0]) : &s_;
 
-                v8::Local<v8::Value> result;
-                if (!script->Run(context).ToLocal(&result))
-                {
-                    pd_error(&x->x_obj, "Error running '%s':\n%s", path.c_str(), js_get_exception_msg(js_isolate, &trycatch).c_str());
-                    return x;
-                }
-            }
-            else
-            {
-                v8::Local<v8::Function> function;
-                v8::ScriptCompiler::Source src(source, origin);
-                v8::Local<v8::Object> args[] = { *global };
+    if (action == gensym("start"))
+    {
+        js_profile_start(title);
+        running = true;
+    }
+    else if (action == gensym("stop"))
+    {
+        string path = argc > 1 ? atom_getsymbol(&argv[1])->s_name : "";
 
-                if (!v8::ScriptCompiler::CompileFunctionInContext(context, &src, 0, NULL, 1, args).ToLocal(&function))
-                {
-                    pd_error(&x->x_obj, "Error compiling '%s':\n%s", path.c_str(), js_get_exception_msg(js_isolate, &trycatch).c_str());
-                    return x;
-                }
+        if (!path.empty() && !sys_isabsolutepath(path.c_str()) && !dir.empty())
+            path = dir + "/" + path;
 
-                v8::Local<v8::Value> result;
-                if (!function->Call(context, *global, 0, NULL).ToLocal(&result))
-                {
-                    pd_error(&x->x_obj, "Error running '%s':\n%s", path.c_str(), js_get_exception_msg(js_isolate, &trycatch).c_str());
-                    return x;
-                }
-            }
-        }
+        js_profile_stop(owner, title, path);
+        running = false;
+    }
+    else if (action == gensym("interval") && argc > 1)
+    {
+        // applies to profiles started afterwards
+        js_profile_interval = std::max(1, (int)atom_getfloat(&argv[1]));
+    }
+    else
+    {
+        pd_error(owner, "Usage: profile start, profile stop [file] or profile interval <us>.");
     }
-
-    return x;
 }
 
 static void js_free(t_js* x)
 {
     if (x->context != nullptr)
     {
+        // settle queued promise reactions while their outlets still exist (only possible
+        // when the object isn't deleted from inside a call into JS)
+        js_run_microtasks();
+
+        {
+            v8::HandleScope handle_scope(js_isolate);
+            auto context = x->context->Get(js_isolate);
+            v8::Context::Scope context_scope(context);
+            js_release_modules(x, false);
+            js_tilde_release(x);
+            js_clear_timers(x);
+            // the context may outlive the object, e.g. in a heap report
+            context->SetAlignedPointerInEmbedderData(js_context_owner, nullptr);
+
+            if (x->profiling)
+                js_profile_stop(&x->x_obj, js_profile_title(x), "");
+        }
+
         x->context->Reset();
         delete x->context;
         x->context = nullptr;
@@ -825,16 +3469,127 @@ static void js_menu_open(t_js* x)
 }
 #endif
 
+static bool js_get_function(v8::Local<v8::Context> context, v8::Local<v8::String> name, v8::Local<v8::Function>* func)
+{
+    v8::Local<v8::Value> val;
+
+    if (!context->Global()->Get(context, name).ToLocal(&val) || !val->IsFunction())
+        return false;
+
+    *func = v8::Local<v8::Function>::Cast(val);
+    return true;
+}
+
+static bool js_get_int_property(v8::Local<v8::Context> context, v8::Local<v8::Function> func, v8::Local<v8::String> name, int32_t* value)
+{
+    v8::Local<v8::Value> propVal;
+
+    return func->GetRealNamedProperty(context, name).ToLocal(&propVal)
+        && propVal->Int32Value(context).To(value);
+}
+
+// Looks up the function that handles messages named sel (falling back to anything).
+// Scripts may replace handlers at any time, so this runs on every message; only the
+// internalized names are cached.
+static bool js_get_handler(v8::Local<v8::Context> context, const t_symbol* sel, bool fallback, v8::Local<v8::Function>* func)
+{
+    static v8::Eternal<v8::String> anything;
+
+    if (anything.IsEmpty())
+        anything.Set(js_isolate, v8::String::NewFromUtf8Literal(js_isolate, "anything", v8::NewStringType::kInternalized));
+
+    return js_get_function(context, js_symbol_string(js_isolate, sel), func)
+        || (fallback && js_get_function(context, anything.Get(js_isolate), func));
+}
+
+// Loads a script under the watchdog and records how long it took.
+static t_js* js_compile(t_js* x, const char* script_name)
+{
+    js_watch_load_begin();
+    auto start = std::chrono::steady_clock::now();
+    auto result = js_load(x, script_name);
+    x->stats.compile_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    js_watch_end();
+
+    return result;
+}
+
+// js~ has no message outlets, its counters are posted instead.
+static void js_stats_output(t_js* x, const char* name, double value)
+{
+    t_atom a;
+
+    if (x->outlets.empty())
+    {
+        post("%s: %s %g", js_post_name(x), name, value);
+        return;
+    }
+
+    SETFLOAT(&a, (t_float)value);
+    outlet_anything(x->outlets[0], gensym(name), 1, &a);
+}
+
+// stats outputs the counters of x on its left outlet, stats reset resets them.
+// stats global outputs the statistics of the heap shared by all js objects and
+// posts the sizes of all contexts once V8 has measured them.
+static void js_stats(t_js* x, int argc, const t_atom* argv)
+{
+    auto arg = argc > 0 ? atom_getsymbol(&argv[0]) : &s_;
+
+    if (arg == gensym("reset"))
+    {
+        x->stats = t_js_stats();
+        return;
+    }
+
+    if (arg == gensym("global"))
+    {
+        v8::HeapStatistics heap;
+
+        js_isolate->GetHeapStatistics(&heap);
+        js_stats_output(x, "heapused", heap.used_heap_size() / 1024.0);
+        js_stats_output(x, "heaptotal", heap.total_heap_size() / 1024.0);
+        js_stats_output(x, "heaplimit", heap.heap_size_limit() / 1024.0);
+        js_stats_output(x, "external", heap.external_memory() / 1024.0);
+        js_stats_output(x, "contexts", (double)heap.number_of_native_contexts());
+        js_stats_output(x, "detachedcontexts", (double)heap.number_of_detached_contexts());
+        // measured along with the next regular collection, an eager measurement would force one
+        js_isolate->MeasureMemory(std::unique_ptr<v8::MeasureMemoryDelegate>(new js_heap_report("context sizes", SIZE_MAX)),
+            v8::MeasureMemoryExecution::kDefault);
+        return;
+    }
+
+    auto& stats = x->stats;
+
+    js_stats_output(x, "messages", (double)stats.messages);
+    js_stats_output(x, "time", stats.total_us / 1000);
+    js_stats_output(x, "maxtime", stats.max_us / 1000);
+    js_stats_output(x, "outlets", (double)stats.outlets);
+    js_stats_output(x, "atomsin", (double)stats.atoms_in);
+    js_stats_output(x, "atomsout", (double)stats.atoms_out);
+    js_stats_output(x, "compiletime", stats.compile_us / 1000);
+}
+
 static void js_anything(t_js_inlet* inlet, const t_symbol* s, int argc, const t_atom* argv)
 {
-    const char* name = s == &s_float ? "msg_float" : s->s_name;
-    auto msgname = string(name);
+    static const t_symbol* msg_float = gensym("msg_float");
+    static const t_symbol* msg_compile = gensym("compile");
+    static const t_symbol* msg_setprop = gensym("setprop");
+    static const t_symbol* msg_getprop = gensym("getprop");
+    static const t_symbol* msg_delprop = gensym("delprop");
+    static const t_symbol* msg_loadbang = gensym("loadbang");
+    static const t_symbol* msg_jsobject = gensym("jsobject");
+    static const t_symbol* msg_dspstats = gensym("dspstats");
+    static const t_symbol* msg_stats = gensym("stats");
+    static const t_symbol* msg_profile = gensym("profile");
+    auto msgname = s == &s_float ? msg_float : s;
+    const char* name = msgname->s_name;
     auto x = inlet->owner;
     v8::HandleScope handle_scope(js_isolate);
     auto context = x->context->Get(js_isolate);
     v8::Context::Scope context_scope(context);
 
-    if (msgname == "compile")
+    if (msgname == msg_compile)
     {
         if (argc > 0 && argv[0].a_type == A_SYMBOL)
         {
@@ -842,14 +3597,34 @@ static void js_anything(t_js_inlet* inlet, const t_symbol* s, int argc, const t_
             x->args.insert(x->args.end(), argv, &argv[argc]);
             js_set_inlets(x, 1);
             js_set_outlets(x, 1);
-            js_load(x, atom_getsymbol(&argv[0])->s_name);
+            js_release_modules(x, true);
+            js_clear_timers(x);
+            js_compile(x, atom_getsymbol(&argv[0])->s_name);
         }
         else
         {
-            js_load(x);
+            js_release_modules(x, true);
+            js_clear_timers(x);
+            js_compile(x, nullptr);
         }
+
+        // new views and perform for the new context
+        if (x->signal)
+            canvas_update_dsp();
+    }
+    else if (msgname == msg_stats)
+    {
+        js_stats(x, argc, argv);
+    }
+    else if (msgname == msg_profile)
+    {
+        js_profile(&x->x_obj, js_profile_title(x), canvas_getdir(x->canvas)->s_name, x->profiling, argc, argv);
+    }
+    else if (msgname == msg_dspstats && x->signal)
+    {
+        js_tilde_dspstats(x, argc > 0 && atom_getsymbol(&argv[0]) == gensym("reset"));
     }
-    else if (msgname == "setprop")
+    else if (msgname == msg_setprop)
     {
         v8::Local<v8::Value> propName;
 
@@ -871,7 +3646,7 @@ static void js_anything(t_js_inlet* inlet, const t_symbol* s, int argc, const t_
             }
         }
     }
-    else if (msgname == "getprop")
+    else if (msgname == msg_getprop)
     {
         v8::Local<v8::Value> propName;
 
@@ -888,7 +3663,7 @@ static void js_anything(t_js_inlet* inlet, const t_symbol* s, int argc, const t_
             }
         }
     }
-    else if (msgname == "delprop")
+    else if (msgname == msg_delprop)
     {
         v8::Local<v8::Value> propName;
 
@@ -897,75 +3672,94 @@ static void js_anything(t_js_inlet* inlet, const t_symbol* s, int argc, const t_
                 return;
     }
 #if WIN32
-    else if (msgname == "open")
+    else if (msgname == gensym("open"))
     {
         js_menu_open(x);
     }
 #endif
     else
     {
-        v8::Local<v8::String> funcName;
+        auto fallback = msgname != msg_loadbang;
+        static v8::Eternal<v8::String> private_name, typedlists_name;
+        v8::Local<v8::Function> func;
 
-        if (v8::String::NewFromUtf8(js_isolate, name).ToLocal(&funcName))
+        if (private_name.IsEmpty())
         {
-            auto fallback = msgname != "loadbang";
-            v8::Local<v8::Value> funcVal;
-            auto hasFunc = context->Global()->Get(context, funcName).ToLocal(&funcVal) && funcVal->IsFunction();
+            private_name.Set(js_isolate, v8::String::NewFromUtf8Literal(js_isolate, "private", v8::NewStringType::kInternalized));
+            typedlists_name.Set(js_isolate, v8::String::NewFromUtf8Literal(js_isolate, "typedlists", v8::NewStringType::kInternalized));
+        }
 
-            if (!hasFunc && fallback && v8::String::NewFromUtf8(js_isolate, "anything").ToLocal(&funcName))
-                hasFunc = context->Global()->Get(context, funcName).ToLocal(&funcVal) && funcVal->IsFunction();
+        if (js_get_handler(context, msgname, fallback, &func))
+        {
+            int32_t isPrivate, funcTypedlists;
 
-            if (hasFunc)
+            if (js_get_int_property(context, func, private_name.Get(js_isolate), &isPrivate) && isPrivate == 1)
             {
-                vector<v8::Local<v8::Value>> args;
-                auto argi = 0;
+                pd_error(&x->x_obj, "Function '%s' is private.", name);
+                return;
+            }
+
+            vector<v8::Local<v8::Value>> args;
+            auto argi = 0;
+
+            if (msgname == msg_jsobject)
+            {
+                v8::Local<v8::Value> val;
 
-                if (msgname == "jsobject")
+                if (argc >= 1 && js_marshal_object(&argv[0], x).ToLocal(&val))
                 {
-                    v8::Local<v8::Value> val;
-
-                    if (argc >= 1 && argv[0].a_type == A_SYMBOL
-                        && js_marshal_object(&argv[0], x).ToLocal(&val))
-                    {
-                        args.push_back(val);
-                        argi++;
-                    }
+                    args.push_back(val);
+                    argi++;
                 }
+            }
 
-                vector<v8::Local<v8::Value>> margs = js_marshal_args(argc + argi, &argv[argi], x);
+            // only lists can be typed, so other messages skip the typedlists lookup
+            auto typedlists = x->typedlists;
+            v8::Local<v8::Value> typed;
 
-                args.insert(args.end(), margs.begin(), margs.end());
+            if (s != &s_float && argc > argi
+                && js_get_int_property(context, func, typedlists_name.Get(js_isolate), &funcTypedlists) && funcTypedlists >= 0)
+                    typedlists = funcTypedlists;
 
-                v8::Local<v8::Function> func = v8::Local<v8::Function>::Cast(funcVal);
-                v8::TryCatch trycatch(js_isolate);
-                v8::Local<v8::Value> result;
-                x->inlet = inlet->index;
-                x->messagename = msgname;
-
-                v8::Local<v8::String> privateName;
-                v8::Local<v8::Value> privateVal;
-                int32_t isPrivate;
-                if (!v8::String::NewFromUtf8(js_isolate, "private").ToLocal(&privateName)
-                    || !func->GetRealNamedProperty(context, privateName).ToLocal(&privateVal)
-                    || !privateVal->Int32Value(context).To(&isPrivate)
-                    || isPrivate != 1)
-                {
-                    if (!func->Call(context, context->Global(), (int)args.size(), args.data()).ToLocal(&result))
-                    {
-                        pd_error(&x->x_obj, "Error calling '%s':\n%s", name, js_get_exception_msg(js_isolate, &trycatch).c_str());
-                    }
-                }
-                else
-                {
-                    pd_error(&x->x_obj, "Function '%s' is private.", name);
-                }
+            if (typedlists != 0 && s != &s_float)
+                typed = js_marshal_typed(argc - argi, &argv[argi], typedlists);
+
+            if (!typed.IsEmpty())
+            {
+                args.push_back(typed);
+            }
+            else
+            {
+                vector<v8::Local<v8::Value>> margs = js_marshal_args(argc - argi, &argv[argi], x);
+
+                args.insert(args.end(), margs.begin(), margs.end());
             }
-            else if (fallback)
+
+            v8::TryCatch trycatch(js_isolate);
+            v8::Local<v8::Value> result;
+            x->inlet = inlet->index;
+            x->messagename = msgname;
+
+            x->stats.messages++;
+            x->stats.atoms_in += argc;
+            js_watch_begin();
+            auto start = std::chrono::steady_clock::now();
+
+            if (!func->Call(context, context->Global(), (int)args.size(), args.data()).ToLocal(&result))
             {
-                pd_error(&x->x_obj, "Function '%s' does not exist.", name);
+                pd_error(&x->x_obj, "Error calling '%s':\n%s", name, js_get_exception_msg(js_isolate, &trycatch).c_str());
             }
+
+            js_count_time(x, start);
+            js_watch_end();
+        }
+        else if (fallback)
+        {
+            pd_error(&x->x_obj, "Function '%s' does not exist.", name);
         }
     }
+
+    js_run_microtasks();
 }
 
 static void js_loadbang(t_js* x, t_floatarg action)
@@ -979,11 +3773,8 @@ static void js_loadbang(t_js* x, t_floatarg action)
     }
 }
 
-static t_js* js_new(const t_symbol*, int argc, t_atom* argv)
+static t_js* js_init(t_js* x, int argc, t_atom* argv)
 {
-    auto x = (t_js*)pd_new(js_class);
-    new(x) t_js; // C++ placement new
-
     x->context = nullptr;
     x->path = "";
     x->canvas = canvas_getcurrent();
@@ -995,12 +3786,253 @@ static t_js* js_new(const t_symbol*, int argc, t_atom* argv)
     js_set_inlets(x, 1);
     js_set_outlets(x, 1);
 
-    if (js_load(x, script_name) == NULL)
+    if (js_compile(x, script_name) == NULL)
         return NULL;
 
+    js_run_microtasks();
+
     return x;
 }
 
+static t_js* js_new(const t_symbol*, int argc, t_atom* argv)
+{
+    auto x = (t_js*)pd_new(js_class);
+    new(x) t_js; // C++ placement new
+
+    return js_init(x, argc, argv);
+}
+
+// A typed array viewing a signal vector of n samples in place.
+static v8::Local<v8::Value> js_tilde_view(t_js* x, t_sample* vec, int n)
+{
+    auto store = v8::ArrayBuffer::NewBackingStore(vec, n * sizeof(t_sample), [](void*, size_t, void*) {}, nullptr);
+    auto buffer = v8::ArrayBuffer::New(js_isolate, std::move(store));
+
+    x->signal_buffers.emplace_back(js_isolate, buffer);
+
+#if PD_FLOATSIZE == 64
+    return v8::Float64Array::New(buffer, 0, n);
+#else
+    return v8::Float32Array::New(buffer, 0, n);
+#endif
+}
+
+// Called every block, so it only uses what js_tilde_dsp set up: one handle scope with a
+// fixed number of handles, a stack TryCatch and no C++ allocations unless perform throws.
+static t_int* js_tilde_perform(t_int* w)
+{
+    auto x = (t_js*)w[1];
+
+    if (x->perform.IsEmpty())
+    {
+        for (auto out : x->signal_out)
+            std::fill(out, out + x->signal_n, (t_sample)0);
+
+        return w + 2;
+    }
+
+    v8::HandleScope handle_scope(js_isolate);
+    auto context = x->context->Get(js_isolate);
+    v8::Context::Scope context_scope(context);
+    v8::TryCatch trycatch(js_isolate);
+    v8::Local<v8::Value> argv[] = { x->signal_inputs.Get(js_isolate), x->signal_outputs.Get(js_isolate) };
+    v8::Local<v8::Value> result;
+    auto& stats = x->dspstats;
+    auto gcs = js_gc_count;
+    auto buffers = js_allocator->count;
+    auto sample = stats.blocks % js_dspstats_heap_period == 0;
+    auto heap = sample ? js_heap_allocated() : 0;
+
+    auto start = std::chrono::steady_clock::now();
+    x->performing = true;
+    js_watch_begin();
+
+    if (!x->perform.Get(js_isolate)->Call(context, context->Global(), 2, argv).ToLocal(&result))
+    {
+        pd_error(&x->x_obj, "Error calling 'perform':\n%s", js_get_exception_msg(js_isolate, &trycatch).c_str());
+        // don't report the same error every block, perform is bound again when DSP restarts
+        x->perform.Reset();
+    }
+
+    js_watch_end();
+    x->performing = false;
+    auto us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    if (sample)
+    {
+        stats.heap_samples++;
+        stats.heap_bytes += js_heap_allocated() - heap;
+    }
+
+    stats.blocks++;
+    stats.last_us = us;
+    stats.total_us += us;
+    stats.max_us = std::max(stats.max_us, us);
+    if (us > x->block_us)
+        stats.overruns++;
+    stats.buffers += js_allocator->count - buffers;
+    stats.gcs += js_gc_count - gcs;
+
+    return w + 2;
+}
+
+// Builds the views over this chain's signal vectors once; perform gets the same
+// inputs and outputs arrays every block. perform is looked up when DSP starts.
+static void js_tilde_dsp(t_js* x, t_signal** sp)
+{
+    auto nin = 1 + (int)x->signal_inlets.size();
+    auto nout = (int)x->signal_outlets.size();
+    auto n = sp[0]->s_n;
+    v8::HandleScope handle_scope(js_isolate);
+    auto context = x->context->Get(js_isolate);
+    v8::Context::Scope context_scope(context);
+    v8::Local<v8::Function> perform;
+    vector<v8::Local<v8::Value>> inputs, outputs;
+
+    js_tilde_release(x);
+
+    for (int i = 0; i < nin; i++)
+        inputs.push_back(js_tilde_view(x, sp[i]->s_vec, n));
+
+    for (int i = 0; i < nout; i++)
+    {
+        outputs.push_back(js_tilde_view(x, sp[nin + i]->s_vec, n));
+        x->signal_out.push_back(sp[nin + i]->s_vec);
+    }
+
+    x->signal_n = n;
+    x->block_us = 1e6 * n / sp[0]->s_sr;
+    x->signal_inputs.Reset(js_isolate, v8::Array::New(js_isolate, inputs.data(), inputs.size()));
+    x->signal_outputs.Reset(js_isolate, v8::Array::New(js_isolate, outputs.data(), outputs.size()));
+
+    if (js_get_function(context, v8::String::NewFromUtf8Literal(js_isolate, "perform"), &perform))
+        x->perform.Reset(js_isolate, perform);
+
+    dsp_add(js_tilde_perform, 1, x);
+}
+
+static void js_tilde_anything(t_js* x, const t_symbol* s, int argc, const t_atom* argv)
+{
+    js_anything(x->inlets[0], s, argc, argv);
+}
+
+static void js_tilde_bang(t_js* x)
+{
+    js_anything(x->inlets[0], &s_bang, 0, NULL);
+}
+
+static t_js* js_tilde_new(const t_symbol*, int argc, t_atom* argv)
+{
+    auto x = (t_js*)pd_new(js_tilde_class);
+    new(x) t_js; // C++ placement new
+
+    x->signal = true;
+
+    return js_init(x, argc, argv);
+}
+
+// GC scheduling. With a gcbudget set, a clock gives V8 that many ms of idle time every
+// gcinterval ms (every DSP tick if 0), so that incremental marking and other collection
+// work happen between ticks. Off by default, V8 then schedules collections itself and
+// its scavenge job runs from the task clock below.
+static t_clock* js_gc_clock = NULL;
+static double js_gc_budget = 0;
+static double js_gc_interval = 0;
+
+static void js_gc_tick(void* dummy)
+{
+    if (js_gc_budget > 0)
+        js_isolate->IdleNotificationDeadline(js_platform->MonotonicallyIncreasingTime() + js_gc_budget / 1000);
+
+    clock_delay(js_gc_clock, js_gc_interval > 0 ? js_gc_interval : js_tick_ms());
+}
+
+// Runs the tasks V8 posts to the main thread (finalizing concurrent compilation and
+// optimization, async WebAssembly compilation, GC finalization), then idle tasks,
+// for at most taskbudget ms every taskinterval ms (every DSP tick if 0). Until a
+// budget is set it's a quarter of a DSP tick, so the audio thread keeps most of the tick.
+static t_clock* js_task_clock = NULL;
+static double js_task_budget = -1;
+static double js_task_interval = 0;
+
+static void js_task_tick(void* dummy)
+{
+    auto platform = js_platform.get();
+    auto budget = js_task_budget >= 0 ? js_task_budget : js_tick_ms() / 4;
+    auto deadline = platform->MonotonicallyIncreasingTime() + budget / 1000;
+
+    while (platform->MonotonicallyIncreasingTime() < deadline
+        && v8::platform::PumpMessageLoop(platform, js_isolate))
+        ;
+
+    auto idle = deadline - platform->MonotonicallyIncreasingTime();
+
+    if (idle > 0)
+        v8::platform::RunIdleTasks(platform, js_isolate, idle);
+
+    // tasks such as async WebAssembly compilation settle promises
+    js_run_microtasks();
+
+    clock_delay(js_task_clock, js_task_interval > 0 ? js_task_interval : js_tick_ms());
+}
+
+// Settings for all js objects, sent to the receiver pdjs, e.g. [; pdjs gcbudget 2(
+typedef struct _js_settings
+{
+    t_pd pd;
+} t_js_settings;
+
+static void js_settings_gcbudget(t_js_settings* x, t_floatarg f)
+{
+    js_gc_budget = std::max(0.0f, f);
+}
+
+static void js_settings_gcinterval(t_js_settings* x, t_floatarg f)
+{
+    js_gc_interval = std::max(0.0f, f);
+}
+
+static void js_settings_taskbudget(t_js_settings* x, t_floatarg f)
+{
+    js_task_budget = std::max(0.0f, f);
+}
+
+static void js_settings_taskinterval(t_js_settings* x, t_floatarg f)
+{
+    js_task_interval = std::max(0.0f, f);
+}
+
+// Arrays are shared by all js objects, so is the interval they are redrawn at.
+static void js_settings_redrawinterval(t_js_settings* x, t_floatarg f)
+{
+    js_pdarray_interval = std::max(0.0f, f);
+}
+
+static void js_settings_timeout(t_js_settings* x, t_floatarg f)
+{
+    js_watch_timeout = std::max(0.0f, f);
+}
+
+static void js_settings_loadtimeout(t_js_settings* x, t_floatarg f)
+{
+    js_watch_load_timeout = std::max(0.0f, f);
+}
+
+// [; pdjs profile start( profiles all js objects; relative files are written to Pd's
+// current directory.
+static void js_settings_profile(t_js_settings* x, t_symbol* s, int argc, t_atom* argv)
+{
+    static bool running = false;
+
+    js_profile(NULL, "pdjs", "", running, argc, argv);
+}
+
+// A full collection now, e.g. before a performance or while DSP is off.
+static void js_settings_gc(t_js_settings* x)
+{
+    js_isolate->LowMemoryNotification();
+}
+
 extern "C" void js_setup(void)
 {
     t_class* c = NULL;
@@ -1028,15 +4060,50 @@ extern "C" void js_setup(void)
     v8::V8::InitializeExternalStartupData(js_path);
 #endif
 
-    js_platform = v8::platform::NewDefaultPlatform();
+    // idle tasks are run from js_task_tick
+    js_platform = v8::platform::NewDefaultPlatform(0, v8::platform::IdleTaskSupport::kEnabled);
     v8::V8::InitializePlatform(js_platform.get());
     v8::V8::Initialize();
 
     // Create a new Isolate and make it the current one.
     v8::Isolate::CreateParams create_params;
-    create_params.array_buffer_allocator =
-        v8::ArrayBuffer::Allocator::NewDefaultAllocator();
+    // the heap limit in MB, e.g. for small devices; V8 picks one from the system memory otherwise
+    auto heap_limit = getenv("PDJS_HEAP_LIMIT");
+    if (heap_limit != NULL && atoi(heap_limit) > 0)
+        create_params.constraints.ConfigureDefaultsFromHeapSize(0, (size_t)atoi(heap_limit) << 20);
+    js_allocator = new js_counting_allocator();
+    create_params.array_buffer_allocator = js_allocator;
     js_isolate = v8::Isolate::New(create_params);
+    js_isolate->AddGCPrologueCallback(js_gc_prologue);
+    js_isolate->AddGCEpilogueCallback(js_gc_epilogue);
+    js_isolate->AddNearHeapLimitCallback(js_near_heap_limit, nullptr);
+    js_isolate->AutomaticallyRestoreInitialHeapLimit();
+    // promise jobs run at js_run_microtasks() checkpoints, in Pd's logical time
+    js_isolate->SetMicrotasksPolicy(v8::MicrotasksPolicy::kExplicit);
+    js_isolate->SetHostImportModuleDynamicallyCallback(js_import_dynamic);
+    js_isolate->SetHostInitializeImportMetaObjectCallback(js_import_meta);
+    std::thread(js_watch_run).detach();
+
+    js_pdarray_clock = clock_new(NULL, (t_method)js_pdarray_tick);
+    js_timer_clock = clock_new(NULL, (t_method)js_timer_run);
+    js_timer_unit = clock_getsystimeafter(1) - clock_getlogicaltime();
+    js_gc_clock = clock_new(NULL, (t_method)js_gc_tick);
+    clock_delay(js_gc_clock, 0);
+    js_task_clock = clock_new(NULL, (t_method)js_task_tick);
+    clock_delay(js_task_clock, 0);
+
+    c = class_new(gensym("pdjs"), 0, 0, sizeof(t_js_settings), CLASS_PD, A_NULL);
+    class_addmethod(c, (t_method)js_settings_gcbudget, gensym("gcbudget"), A_FLOAT, 0);
+    class_addmethod(c, (t_method)js_settings_gcinterval, gensym("gcinterval"), A_FLOAT, 0);
+    class_addmethod(c, (t_method)js_settings_taskbudget, gensym("taskbudget"), A_FLOAT, 0);
+    class_addmethod(c, (t_method)js_settings_taskinterval, gensym("taskinterval"), A_FLOAT, 0);
+    class_addmethod(c, (t_method)js_settings_redrawinterval, gensym("redrawinterval"), A_FLOAT, 0);
+    class_addmethod(c, (t_method)js_settings_timeout, gensym("timeout"), A_FLOAT, 0);
+    class_addmethod(c, (t_method)js_settings_loadtimeout, gensym("loadtimeout"), A_FLOAT, 0);
+    class_addmethod(c, (t_method)js_settings_profile, gensym("profile"), A_GIMME, 0);
+    class_addmethod(c, (t_method)js_settings_gc, gensym("gc"), A_NULL);
+    js_settings_class = c;
+    pd_bind(pd_new(c), gensym("pdjs"));
 
     c = class_new(gensym("js-inlet"), 0, 0, sizeof(t_js_inlet), CLASS_PD, A_NULL);
     if (c)
@@ -1053,5 +4120,17 @@ extern "C" void js_setup(void)
 
     js_class = c;
 
+    c = class_new(gensym("js~"), (t_newmethod)js_tilde_new, (t_method)js_free, sizeof(t_js), 0, A_GIMME, 0);
+    CLASS_MAINSIGNALIN(c, t_js, signal_f);
+    class_addmethod(c, (t_method)js_tilde_dsp, gensym("dsp"), A_CANT, 0);
+    class_addmethod(c, (t_method)js_loadbang, gensym("loadbang"), A_DEFFLOAT, 0);
+    class_addbang(c, (t_method)js_tilde_bang);
+    class_addanything(c, (t_method)js_tilde_anything);
+#if WIN32
+    class_addmethod(c, (t_method)js_menu_open, gensym("menu-open"), A_NULL);
+#endif
+
+    js_tilde_class = c;
+
     post("pdjs version " V8_S(VERSION) " (v8 version " V8_VERSION_STRING ")");
 }
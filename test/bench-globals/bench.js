@@ -0,0 +1,40 @@
+include("../bench.js");
+
+inlets = 1;
+outlets = 1;
+
+var counter = 0;
+var total = 0;
+
+function square(v) {
+    return v * v;
+}
+
+function bang() {
+    bench("global read/write", 10000000, function (n) {
+        for (var i = 0; i < n; i++) {
+            counter = counter + 1;
+            total += counter;
+        }
+    });
+
+    bench("global function call", 10000000, function (n) {
+        for (var i = 0; i < n; i++)
+            total += square(i);
+    });
+
+    bench("inlets/outlets read", 10000000, function (n) {
+        for (var i = 0; i < n; i++)
+            total += inlets + outlets;
+    });
+
+    bench("messagename read", 1000000, function (n) {
+        for (var i = 0; i < n; i++)
+            total += messagename.length;
+    });
+
+    bench("__global__ read", 10000000, function (n) {
+        for (var i = 0; i < n; i++)
+            total += __global__ !== undefined ? 1 : 0;
+    });
+}
@@ -0,0 +1,27 @@
+include("../bench.js");
+
+inlets = 1;
+outlets = 1;
+
+// objects stay reachable so their jsobject handles remain registered
+var live = [];
+
+function bang() {
+    [100, 1000, 10000, 100000].forEach(function (count) {
+        while (live.length < count) {
+            var o = { i: live.length };
+            live.push(o);
+            outlet(0, o);
+        }
+
+        bench("outlet known object, " + count + " live jsobjects", 100000, function (n) {
+            for (var i = 0; i < n; i++)
+                outlet(0, live[i % count]);
+        });
+
+        bench("outlet new object, " + count + " live jsobjects", 10000, function (n) {
+            for (var i = 0; i < n; i++)
+                outlet(0, { i: i });
+        });
+    });
+}
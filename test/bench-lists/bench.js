@@ -0,0 +1,42 @@
+include("../bench.js");
+
+inlets = 1;
+outlets = 1;
+
+// Sends 1024-element lists from plain arrays and typed arrays.
+function bang() {
+    var size = 1024;
+    var array = [];
+    var f32 = new Float32Array(size);
+    var f64 = new Float64Array(size);
+
+    for (var i = 0; i < size; i++) {
+        array.push(i / size);
+        f32[i] = f64[i] = i / size;
+    }
+
+    bench("outlet(0, array)", 10000, function (n) {
+        for (var i = 0; i < n; i++)
+            outlet(0, array);
+    });
+
+    bench("outlet(0, Float32Array)", 10000, function (n) {
+        for (var i = 0; i < n; i++)
+            outlet(0, f32);
+    });
+
+    bench("outlet[0].list(Float64Array)", 10000, function (n) {
+        for (var i = 0; i < n; i++)
+            outlet[0].list(f64);
+    });
+
+    bench("messnamed(name, array)", 10000, function (n) {
+        for (var i = 0; i < n; i++)
+            messnamed("bench-lists", array);
+    });
+
+    bench("messnamed(name, Float32Array)", 10000, function (n) {
+        for (var i = 0; i < n; i++)
+            messnamed("bench-lists", f32);
+    });
+}
@@ -0,0 +1,35 @@
+include("../bench.js");
+
+inlets = 1;
+outlets = 1;
+
+// Compares the generic calls with the outlet handles.
+// Nothing is connected, so this measures the call itself.
+function bang() {
+    var out = outlet[0];
+
+    bench("outlet(0, f)", 1000000, function (n) {
+        for (var i = 0; i < n; i++)
+            outlet(0, i);
+    });
+
+    bench("outlet[0].float(f)", 1000000, function (n) {
+        for (var i = 0; i < n; i++)
+            out.float(i);
+    });
+
+    bench("outlet(0, \"bang\")", 1000000, function (n) {
+        for (var i = 0; i < n; i++)
+            outlet(0, "bang");
+    });
+
+    bench("outlet[0].bang()", 1000000, function (n) {
+        for (var i = 0; i < n; i++)
+            out.bang();
+    });
+
+    bench("messnamed(name, f)", 1000000, function (n) {
+        for (var i = 0; i < n; i++)
+            messnamed("bench-outlet", i);
+    });
+}
@@ -0,0 +1,27 @@
+include("../bench.js");
+
+inlets = 1;
+outlets = 1;
+
+var names = [];
+
+for (var i = 0; i < 256; i++)
+    names.push("route" + i);
+
+// Symbol traffic from a small set of names, as in routing patches.
+function bang() {
+    bench("outlet(0, symbol)", 1000000, function (n) {
+        for (var i = 0; i < n; i++)
+            outlet(0, names[i & 255]);
+    });
+
+    bench("outlet[0].anything(selector, symbol)", 1000000, function (n) {
+        for (var i = 0; i < n; i++)
+            outlet[0].anything(names[i & 255], names[(i + 1) & 255]);
+    });
+
+    bench("messnamed(name, selector, symbol)", 1000000, function (n) {
+        for (var i = 0; i < n; i++)
+            messnamed("bench-symbols", names[i & 255], names[(i + 1) & 255]);
+    });
+}
@@ -0,0 +1,22 @@
+include("../bench.js");
+
+// Scheduling and cancelling should cost the same no matter how many timers are
+// pending, as in a sequencer that has queued its notes minutes ahead.
+function bang() {
+    function noop() {}
+
+    function schedule(n) {
+        var ids = [];
+        for (var i = 0; i < n; i++)
+            ids.push(setTimeout(noop, Math.random() * 600000));
+        for (var i = 0; i < n; i++)
+            clearTimeout(ids[i]);
+    }
+
+    bench("setTimeout + clearTimeout", 100000, schedule);
+
+    for (var i = 0; i < 100000; i++)
+        setTimeout(noop, Math.random() * 600000);
+
+    bench("setTimeout + clearTimeout, 100000 pending", 100000, schedule);
+}
@@ -0,0 +1,8 @@
+// Shared helper for the bench-* patches, pulled in with include("../bench.js").
+function bench(name, iterations, fn) {
+    fn(Math.ceil(iterations / 10)); // warm up so the measured run is optimized
+    var start = Date.now();
+    fn(iterations);
+    var ms = Math.max(Date.now() - start, 1);
+    post(name + ":", Math.round(iterations / ms * 1000), "ops/s");
+}
@@ -0,0 +1,39 @@
+#!/bin/bash
+
+PD_EXT=""
+if [ "$OS" = "Windows_NT" ]; then
+    export TRIPLET="x64-windows"
+    PD_EXT=".com"
+else
+    if [ `uname -s` = "Linux" ]; then
+        TRIPLET="linux"
+    elif [ `uname -s` = "Darwin" ]; then
+        TRIPLET="macos"
+    fi
+    if [ `uname -m` = "x86_64" ]; then
+        export TRIPLET="x64-${TRIPLET}"
+    elif [ `uname -m` = "aarch64" ]; then
+        export TRIPLET="arm64-${TRIPLET}"
+    elif [ `uname -m` = "armv7l" ]; then
+        export TRIPLET="arm-${TRIPLET}"
+    fi
+fi
+
+export PD="../pd/${TRIPLET}/bin/pd${PD_EXT}"
+
+# Benchmarks print their timings instead of being compared to a result file.
+# Pass a pattern to run a subset, e.g. ./bench.sh globals
+for BENCHFILE in bench-*${1}*/bench-*.pd; do
+
+    BENCH=`basename $BENCHFILE`
+    BENCHDIR=`dirname $BENCHFILE`
+    echo "$BENCH:"
+
+    pushd $BENCHDIR > /dev/null
+
+    . ../run.sh $BENCH
+
+    grep -v "^pdjs version" result.${TRIPLET}.txt
+
+    popd > /dev/null
+done
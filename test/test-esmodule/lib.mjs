@@ -0,0 +1,12 @@
+let count = 0;
+
+export function greet(name) {
+    count++;
+    return "hello " + name;
+}
+
+export function counter() {
+    return count;
+}
+
+post("lib.mjs evaluated", typeof outlet);
@@ -0,0 +1,15 @@
+import { greet, counter } from "./lib.mjs";
+import * as lib from "./lib.mjs";
+
+inlets = 1;
+outlets = 1;
+
+post(greet("import"));
+post("same module", lib.counter === counter);
+post("import.meta.url", import.meta.url.endsWith("/test.mjs"));
+
+export function bang() {
+    import("./lib.mjs").then(function (m) {
+        post(m.greet("dynamic import"), m.counter());
+    });
+}
@@ -16,4 +16,13 @@ function bang() {
     messnamed("mess", 3.14);
     messnamed("mess", "test");
     messnamed("mess", "test", [1, 2, 3], 4);
+    outlet[0].float(1.5);
+    outlet[1].bang();
+    outlet[0].list([1, 2, 3]);
+    outlet[1].symbol("sym");
+    outlet[0].anything("foo", 1, "bar");
+    outlet(0, new Float32Array([1, 2, 3]));
+    outlet[0].list(new Int32Array([4, 5, 6]));
+    messnamed("mess", new Float64Array([0.25, 0.5]));
+    outlet[0].list([1, [2, 3]]);
 }
@@ -32,3 +32,21 @@ private.private = 1;
 function exception() {
     throw "exception";
 }
+
+function redefine() {
+    bang = function () {
+        post("redefined bang");
+    };
+}
+
+function frame(a) {
+    post("frame", a.constructor.name, a.length, Array.from(a));
+}
+
+frame.typedlists = 32;
+
+// flags set after the first call apply to the next one
+function hide() {
+    post("hide");
+    hide.private = 1;
+}
@@ -0,0 +1,30 @@
+function bang() {
+    var a = new PdArray("test-array");
+    post("name", a.name, "length", a.length());
+
+    a.poke(0, new Float32Array([1, 2, 3]));
+    a.poke(3, [4, 5]);
+    a.poke(5, 6);
+    a.poke(7, new Float64Array([7, 8, 9]));
+    post("peek", Array.from(a.peek(0, 10)));
+
+    var target = new Float64Array(2);
+    a.peek(1, target);
+    post("target", Array.from(target));
+
+    a.poke(0, [10, 20], false);
+    a.redraw();
+    messnamed("pdjs", "redrawinterval", 16);
+    post("noredraw", Array.from(a.peek(0, 2)));
+
+    a.resize(4);
+    post("resized", a.length(), Array.from(a.peek(0, 8)));
+    a.poke(2, [{ valueOf: function () { a.resize(3); return 30; } }, 40]);
+    post("shrunk", a.length(), Array.from(a.peek(0, 4)));
+
+    try {
+        new PdArray("missing").length();
+    } catch (e) {
+        post(e.message);
+    }
+}
@@ -0,0 +1,7 @@
+// the profile started before compile is stopped after it
+function bang() {
+    var sum = 0;
+    for (var i = 0; i < 100000; i++)
+        sum += i;
+    post("other.js", sum);
+}
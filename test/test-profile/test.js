@@ -0,0 +1,3 @@
+function bang() {
+    post("test.js");
+}
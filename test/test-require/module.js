@@ -0,0 +1,11 @@
+post("module require", require("require.js").foo);
+
+try {
+    outlet(0, "bang");
+} catch (e) {
+    post("module outlet", e.message);
+}
+
+module.exports = function () {
+    post("module.exports", __filename.endsWith("module.js"));
+}
@@ -9,6 +9,8 @@ var req = require("require.js");
 req.bar();
 post("require foo", req.foo);
 require(); // -> undefined
+post("require cached", require("require.js") === req);
+require("module.js")();
 
 include("compile_error.js", o);
 include("run_error.js", {});
@@ -0,0 +1,24 @@
+inlets = 1;
+outlets = 1;
+
+var blocks = 0;
+var input;
+var reused = true;
+
+function perform(inputs, outputs) {
+    var output = outputs[0];
+
+    if (input === undefined)
+        input = inputs[0];
+    else if (input !== inputs[0])
+        reused = false;
+
+    for (var i = 0; i < output.length; i++)
+        output[i] = input[i] * 2;
+
+    blocks++;
+}
+
+function bang() {
+    post("inlets", inlets, "outlets", outlets, "blocks", blocks > 0, "reused", reused, input.constructor.name, input.length);
+}
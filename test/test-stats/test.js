@@ -0,0 +1,4 @@
+function list(a, b) {
+    outlet(0, a + b);
+    outlet[0].list([a, b, a + b]);
+}
@@ -0,0 +1,4 @@
+function bang() {
+    Promise.resolve("nested microtask").then(post);
+    post("nested");
+}
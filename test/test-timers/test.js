@@ -0,0 +1,44 @@
+function bang() {
+    post("start");
+
+    setTimeout(function (a, b) { post("timeout", a, b); }, 12, "x", 1);
+    setTimeout(post, 12.5, "second in the same ms");
+    setTimeout(post, 12.25, "first in the same ms");
+    setTimeout(post, 300, "cascaded");
+
+    var cancelled = setTimeout(function () { post("cancelled"); }, 5);
+    clearTimeout(cancelled);
+
+    var n = 0;
+    var interval = setInterval(function () {
+        if (++n === 3) {
+            clearInterval(interval);
+            post("interval", n);
+        }
+    }, 5);
+
+    var task = new Task(function (v) {
+        post("task", this.name, v, task.iterations, task.running);
+    }, { name: "obj" }, 7);
+    task.interval = 20;
+    task.repeat(2);
+
+    // NaN delays fire right away, NaN intervals every DSP tick, huge ones never during the test
+    setTimeout(post, NaN, "timeout NaN");
+    setTimeout(post, Infinity, "timeout Infinity");
+    setTimeout(post, 1e300, "timeout 1e300");
+    var m = 0;
+    var nan = setInterval(function () {
+        if (++m === 2) {
+            clearInterval(nan);
+            post("interval NaN", m);
+        }
+    }, "x");
+    setInterval(post, Infinity, "interval Infinity");
+    setInterval(post, 1e300, "interval 1e300");
+
+    Promise.resolve("microtask").then(post);
+    // reactions queued by the nested call wait until this call has returned
+    messnamed("nested", "bang");
+    post("end");
+}
@@ -0,0 +1,8 @@
+function hang() {
+    while (true) {
+    }
+}
+
+function bang() {
+    post("alive");
+}
@@ -55,10 +55,21 @@ for TESTFILE in test-*/test-*.pd; do
     perl -pi -e'' "${JSOBJECT_REGEX}" ./expected.txt
     perl -pi -e'' "${JSOBJECT_REGEX}" ./actual.txt
 
+    TERMINATED_REGEX="s/^Terminated after [0-9]+ ms/Terminated after 100 ms/g"
+    perl -pi -e'' "${TERMINATED_REGEX}" ./expected.txt
+    perl -pi -e'' "${TERMINATED_REGEX}" ./actual.txt
+
+    PROFILE_REGEX="s/^js: profile written to .*\/(.+)/js: profile written to \1/g"
+    perl -pi -e'' "${PROFILE_REGEX}" ./expected.txt
+    perl -pi -e'' "${PROFILE_REGEX}" ./actual.txt
+
     diff --strip-trailing-cr actual.txt ./expected.txt
 
     TESTSUCCESS=$?
 
+    # profiles written by the test, e.g. test-profile
+    rm -f ./*.cpuprofile
+
     if [ "$TESTSUCCESS" = 0 ]; then
         printf "${GREEN}success${NOCOLOR} ✔️\n"
     else